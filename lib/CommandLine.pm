@@ -89,6 +89,20 @@ has 'precondition' => (
     writer  => '_precondition'
 );
 
+has 'steady_state_rule' => (
+    is  => 'ro',
+    isa => 'Str',
+    default => 'slope',
+    writer  => '_steady_state_rule'
+);
+
+has 'verify' => (
+    is  => 'ro',
+    isa => 'Bool',
+    default => 0,
+    writer  => '_verify'
+);
+
 has 'test_id' => (
     is  => 'ro',
     isa => 'Maybe[Str]',
@@ -271,6 +285,8 @@ sub BUILD
         "purge!"                 => sub { $self->attr(@_) },  
         "initialize!"            => sub { $self->attr(@_) },  
         "precondition!"          => sub { $self->attr(@_) },  
+        "steady_state_rule=s"    => sub { $self->attr(@_) },
+        "verify!"                => sub { $self->attr(@_) },
         "prompt!"                => \$prompt,
         "test_id=s"              => sub { $self->attr(@_) },  
         "test_id_prefix=s"       => sub { $self->attr(@_) },  
@@ -337,6 +353,14 @@ END
         die "Unsupported target_type. Use --target_type=auto|ssd|hdd\n";
     }
     
+    # Canonicalize steady-state rule to lower case
+    $self->_steady_state_rule( lc( $self->steady_state_rule ) );
+
+    unless( $self->steady_state_rule ~~ [qw( slope pts )] )
+    {
+        die "Unsupported steady_state_rule. Use --steady_state_rule=slope|pts\n";
+    }
+    
     if( $self->raw_disk )
     {
         if( $self->active_range != 100 )
@@ -414,6 +438,11 @@ END
 
         die $msg;
     }
+
+    if( $self->verify and $self->compressibility > 0 )
+    {
+        die "--verify needs incompressible data. Drop --compressibility.\n";
+    }
 }
 
 sub get_usage_string
@@ -428,6 +457,10 @@ OPTIONS
   --purge           Erase target before test. Default off for existing volumes.
   --initialize      Write whole target before testing. Defaults on for SSD.
   --precondition    Drive to steady-state before test. Defaults on for SSD.
+  --steady_state_rule=slope|pts
+                    Judge steady-state by slope, or per SNIA PTS.
+                    Defaults to slope.
+  --verify          Check data integrity while preconditioning. Default off.
   --recipe=A.rcp    Use the test list defined in "A.rcp".
   --collect_smart   Collect drive's SMART metadata. Defaults on.
   --collect_logman  Collect performance counters from logman. Defaults on. 
@@ -65,6 +65,12 @@ sub parse($$)
         }
 
         $stats_ref->{'Steady-State Time'} = $time;
+
+        # The rule steady-state was judged by, so reports can cite it
+        if( $ss_line =~ /\((.+)\)/ )
+        {
+            $stats_ref->{'Steady-State Criterion'} = $1;
+        }
     }
     elsif( $ss_line =~ /(abandoned|assumed)/ )
     {
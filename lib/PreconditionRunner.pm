@@ -75,6 +75,8 @@ sub write_num_passes
     my $cmd = "precondition.exe ";
 
     $cmd .= "-n$num_passes ";
+    $cmd .= "-c" . $self->cmd_line->compressibility . " ";
+    $cmd .= "-v " if $self->cmd_line->verify;
     $cmd .= qq(-p"$msg_prefix" );
     $cmd .= "-Y ";
     
@@ -117,13 +119,24 @@ sub run_to_steady_state($)
     $cmd .= "-r " if $access_pattern eq 'random';
     $cmd .= "-o$queue_depth ";
     $cmd .= "-w$write_percentage ";
+    $cmd .= "-c" . $self->cmd_line->compressibility . " ";
+    $cmd .= "-v " if $self->cmd_line->verify;
     $cmd .= "-ss ";
+
+    my $rule = $self->cmd_line->steady_state_rule;
+
+    $cmd .= "-a$rule ";
     
     if( $self->cmd_line->demo_mode )
     {
         $cmd .= "-g" . QUICK_TEST_GATHER_SECONDS . " ";
         $cmd .= "-d" . QUICK_TEST_DWELL_SECONDS . " ";
-        $cmd .= "-t" . QUICK_TEST_SLOPE_TOLERANCE . " ";
+
+        # Only the slope rule has a tolerance to relax
+        if( $rule eq 'slope' )
+        {
+            $cmd .= "-t" . QUICK_TEST_SLOPE_TOLERANCE . " ";
+        }
     }
 
     $cmd .= qq(-p"$msg_prefix" );
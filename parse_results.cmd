@@ -346,6 +346,7 @@ my @cols =
     },
     { name => 'Test Ordinal' },
     { name => 'Steady-State Time' },
+    { name => 'Steady-State Criterion' },
     {
         name   => 'Steady-State Error',
         format => '0%',
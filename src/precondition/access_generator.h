@@ -0,0 +1,706 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __ACCESS_GENERATOR_H_
+#define __ACCESS_GENERATOR_H_
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <random>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+#include <boost/utility.hpp>
+
+#include "precondition.h"
+#include "block_permutation.h"
+#include "alias_table.h"
+
+// Decides where each IO goes within one worker's slice of the target.
+//
+// next() is called once per IO, on the IO thread.  The patterns that
+// need random numbers, a Zipf draw, or a Feistel round per IO derive
+// from BatchedAccessGenerator, which does that work a batch at a time
+// and leaves next() with a load and an align.
+class AccessGenerator : boost::noncopyable
+{
+    protected:
+
+    const int64_t SLICE_START;
+    const int64_t SLICE_BYTES;
+
+    public:
+
+    AccessGenerator( int64_t sliceStart, int64_t sliceBytes )
+        : SLICE_START( sliceStart )
+        , SLICE_BYTES( sliceBytes )
+    {}
+
+    virtual ~AccessGenerator() {}
+
+    // Byte offset on the target for an IO of this many bytes.  May
+    // shorten the IO to keep it aligned.  The caller trims whatever
+    // runs past the end of the slice.
+    virtual int64_t next( int64_t &bytes ) = 0;
+
+    // Whether next() may have another IO to give.  Only a stream
+    // shared with other workers can run dry before its caller is done.
+    virtual bool hasNext() const
+    {
+        return true;
+    }
+
+    // Call before each next().  Makes sure there is an IO to give, or
+    // returns false if there isn't after all: another worker may have
+    // taken the rest of a shared stream since hasNext() said yes.
+    virtual bool claimNext()
+    {
+        return true;
+    }
+};
+
+class SequentialAccess : public AccessGenerator
+{
+    private:
+
+    int64_t cursor_; // Relative to SLICE_START
+
+    public:
+
+    SequentialAccess( int64_t sliceStart, int64_t sliceBytes )
+        : AccessGenerator( sliceStart, sliceBytes )
+        , cursor_( 0 )
+    {}
+
+    int64_t next( int64_t &bytes )
+    {
+        int64_t offset = SLICE_START + cursor_;
+
+        cursor_ += std::min( bytes, SLICE_BYTES - cursor_ );
+        cursor_ %= SLICE_BYTES;
+
+        return offset;
+    }
+};
+
+// For -k: several sequential streams at once, each over its own region
+// of the slice, taking IOs in turn.  A stream that finishes its region
+// waits for the others, so every pass covers every region exactly once
+// even when the regions differ in size.
+class MultiStreamAccess : public AccessGenerator
+{
+    private:
+
+    // Region i is [BOUNDS[i], BOUNDS[i + 1]), in bytes on the target
+    const std::vector<int64_t> BOUNDS;
+
+    std::vector<int64_t> cursors_;
+    size_t nextStream_;
+    size_t unfinished_; // Streams with some of this pass left
+
+    public:
+
+    explicit MultiStreamAccess( const std::vector<int64_t> &bounds )
+        : AccessGenerator( bounds.front(), bounds.back() - bounds.front() )
+        , BOUNDS( bounds )
+        , cursors_( bounds.begin(), bounds.end() - 1 )
+        , nextStream_( 0 )
+        , unfinished_( cursors_.size() )
+    {}
+
+    int64_t next( int64_t &bytes )
+    {
+        const size_t NUM_STREAMS = cursors_.size();
+
+        if( unfinished_ == 0 )
+        {
+            std::copy( BOUNDS.begin(), BOUNDS.end() - 1, cursors_.begin() );
+
+            unfinished_ = NUM_STREAMS;
+        }
+
+        while( cursors_[nextStream_] == BOUNDS[nextStream_ + 1] )
+        {
+            nextStream_ = ( nextStream_ + 1 ) % NUM_STREAMS;
+        }
+
+        int64_t &cursor = cursors_[nextStream_];
+        int64_t offset = cursor;
+
+        // Regions are whole blocks, so this only trims a mixed-size IO
+        bytes = std::min( bytes, BOUNDS[nextStream_ + 1] - cursor );
+
+        cursor += bytes;
+
+        if( cursor == BOUNDS[nextStream_ + 1] ) unfinished_--;
+
+        nextStream_ = ( nextStream_ + 1 ) % NUM_STREAMS;
+
+        return offset;
+    }
+};
+
+// For -si: one sequential stream over the whole target, fed to every
+// worker.  Workers claim CLAIM_BYTES at a time, in order, with a single
+// fetch_add, so the shared cache line is touched once per claim rather
+// than once per IO.  Claims never straddle a pass, so each pass starts
+// back at offset 0 and ends with the target's short last block.
+class SharedCursor : boost::noncopyable
+{
+    private:
+
+    const int64_t TARGET_BYTES;
+    const int64_t CLAIM_BYTES;
+    const int64_t CLAIMS_PER_PASS;
+    const int64_t END; // In claims
+
+    // Padded onto a cache line of its own, rather than aligned, since
+    // the engine that owns us may come from plain new
+    char padBefore_[ 64 ];
+    std::atomic<int64_t> nextClaim_;
+    char padAfter_[ 64 - sizeof( std::atomic<int64_t> ) ];
+
+    public:
+
+    // With numPasses of 0 the stream never ends
+    SharedCursor( int64_t targetBytes, int64_t claimBytes, int numPasses )
+        : TARGET_BYTES( targetBytes )
+        , CLAIM_BYTES( claimBytes )
+        , CLAIMS_PER_PASS( divRoundUp( targetBytes, claimBytes ) )
+        , END( ( numPasses > 0 ) ? 
+            CLAIMS_PER_PASS * numPasses : 
+            std::numeric_limits<int64_t>::max() )
+        , nextClaim_( 0 )
+    {}
+
+    bool isExhausted() const
+    {
+        return nextClaim_.load( std::memory_order_relaxed ) >= END;
+    }
+
+    // The next unclaimed range of the target, or false once the stream
+    // has run out
+    bool claim( int64_t &start, int64_t &end )
+    {
+        // Racing workers each overshoot by one at most, so a load first
+        // keeps them from hammering the line after the end
+        if( isExhausted() ) return false;
+
+        int64_t claim = nextClaim_.fetch_add( 1, std::memory_order_relaxed );
+
+        if( claim >= END ) return false;
+
+        start = ( claim % CLAIMS_PER_PASS ) * CLAIM_BYTES;
+        end = std::min( start + CLAIM_BYTES, TARGET_BYTES );
+
+        return true;
+    }
+};
+
+// One worker's view of a SharedCursor.  IOs are carved in order from
+// the worker's current claim, so the target sees one ascending stream,
+// reordered at most within the claims in flight at once.
+class SharedSequentialAccess : public AccessGenerator
+{
+    private:
+
+    SharedCursor &shared_;
+
+    int64_t cursor_;
+    int64_t claimEnd_;
+
+    public:
+
+    SharedSequentialAccess( SharedCursor &shared, int64_t targetBytes )
+        : AccessGenerator( 0, targetBytes )
+        , shared_( shared )
+        , cursor_( 0 )
+        , claimEnd_( 0 )
+    {}
+
+    int64_t next( int64_t &bytes )
+    {
+        assert( cursor_ < claimEnd_ );
+
+        int64_t offset = cursor_;
+
+        bytes = std::min( bytes, claimEnd_ - cursor_ );
+
+        cursor_ += bytes;
+
+        return offset;
+    }
+
+    bool hasNext() const
+    {
+        return ( cursor_ < claimEnd_ ) || !shared_.isExhausted();
+    }
+
+    bool claimNext()
+    {
+        if( cursor_ < claimEnd_ ) return true;
+
+        return shared_.claim( cursor_, claimEnd_ );
+    }
+};
+
+// Sequential, from the end of the slice back to the start
+class ReverseAccess : public AccessGenerator
+{
+    private:
+
+    int64_t cursor_; // End of the last IO, relative to SLICE_START
+
+    public:
+
+    ReverseAccess( int64_t sliceStart, int64_t sliceBytes )
+        : AccessGenerator( sliceStart, sliceBytes )
+        , cursor_( sliceBytes )
+    {}
+
+    int64_t next( int64_t &bytes )
+    {
+        int64_t end = SLICE_START + cursor_;
+
+        // Aligned to its own size, so the first IO of a pass may be short
+        int64_t offset = std::max( SLICE_START, ( end - 1 ) / bytes * bytes );
+
+        bytes = end - offset;
+
+        cursor_ = offset - SLICE_START;
+
+        if( cursor_ == 0 ) cursor_ = SLICE_BYTES;
+
+        return offset;
+    }
+};
+
+// Every STRIDE bytes through the slice.  Each sweep starts STEP bytes
+// further in than the last, so with a fixed IO size of STEP a pass
+// still covers the whole slice.
+class StrideAccess : public AccessGenerator
+{
+    private:
+
+    const int64_t STRIDE;
+    const int64_t STEP;
+
+    int64_t phase_;
+    int64_t cursor_;
+
+    public:
+
+    StrideAccess( 
+            int64_t sliceStart, 
+            int64_t sliceBytes, 
+            int64_t stride, 
+            int64_t step )
+        : AccessGenerator( sliceStart, sliceBytes )
+        , STRIDE( stride )
+        , STEP( step )
+        , phase_( 0 )
+        , cursor_( 0 )
+    {}
+
+    int64_t next( int64_t & /* bytes */ )
+    {
+        int64_t offset = SLICE_START + cursor_;
+
+        cursor_ += STRIDE;
+
+        if( cursor_ >= SLICE_BYTES )
+        {
+            phase_ = ( phase_ + STEP ) % STRIDE;
+
+            // A slice shorter than the stride has only the one sweep
+            if( phase_ >= SLICE_BYTES ) phase_ = 0;
+
+            cursor_ = phase_;
+        }
+
+        return offset;
+    }
+};
+
+// Draws whole batches of positions, in units of GRAIN bytes from the
+// start of the slice.  Each IO is aligned down to its own size, like a
+// real workload's would be.
+class BatchedAccessGenerator : public AccessGenerator
+{
+    private:
+
+    static const size_t BATCH_SIZE = 256;
+
+    std::vector<int64_t> batch_;
+    size_t nextInBatch_;
+
+    protected:
+
+    const int64_t GRAIN;
+    const int64_t NUM_UNITS;
+
+    std::mt19937_64 rngEngine_;
+
+    // Overwrite every entry with a unit in [0, NUM_UNITS)
+    virtual void refill( std::vector<int64_t> &units ) = 0;
+
+    public:
+
+    BatchedAccessGenerator( 
+            int64_t sliceStart, 
+            int64_t sliceBytes, 
+            int64_t grain,
+            uint64_t seed )
+        : AccessGenerator( sliceStart, sliceBytes )
+        , batch_( BATCH_SIZE )
+        , nextInBatch_( BATCH_SIZE )
+        , GRAIN( grain )
+        , NUM_UNITS( divRoundUp( sliceBytes, grain ) )
+        , rngEngine_( seed )
+    {}
+
+    int64_t next( int64_t &bytes )
+    {
+        if( nextInBatch_ == batch_.size() )
+        {
+            refill( batch_ );
+            nextInBatch_ = 0;
+        }
+
+        int64_t offset = SLICE_START + batch_[nextInBatch_++] * GRAIN;
+
+        return std::max( SLICE_START, offset / bytes * bytes );
+    }
+};
+
+class UniformAccess : public BatchedAccessGenerator
+{
+    public:
+
+    UniformAccess( 
+            int64_t sliceStart, 
+            int64_t sliceBytes, 
+            int64_t grain, 
+            uint64_t seed )
+        : BatchedAccessGenerator( sliceStart, sliceBytes, grain, seed )
+    {}
+
+    protected:
+
+    void refill( std::vector<int64_t> &units )
+    {
+        std::uniform_int_distribution<int64_t> dist( 0, NUM_UNITS - 1 );
+
+        for( auto &u: units )
+        {
+            u = dist( rngEngine_ );
+        }
+    }
+};
+
+// Random, but a pass must write each unit once and only once, leaving
+// no gaps.  Shuffling a vector of offsets would need ~4 GB of DRAM on
+// a big drive; the permutation needs none.
+class PermutedAccess : public BatchedAccessGenerator
+{
+    private:
+
+    BlockPermutation permutation_;
+    uint64_t seed_;
+    int64_t count_;
+
+    public:
+
+    PermutedAccess( 
+            int64_t sliceStart, 
+            int64_t sliceBytes, 
+            int64_t grain, 
+            uint64_t seed )
+        : BatchedAccessGenerator( sliceStart, sliceBytes, grain, seed )
+        , permutation_( NUM_UNITS )
+        , seed_( seed )
+        , count_( 0 )
+    {}
+
+    protected:
+
+    void refill( std::vector<int64_t> &units )
+    {
+        for( auto &u: units )
+        {
+            int64_t indexInPass = count_ % NUM_UNITS;
+
+            // A fresh order every pass
+            if( indexInPass == 0 )
+            {
+                permutation_.rekey( seed_ + count_ / NUM_UNITS );
+            }
+
+            u = static_cast<int64_t>( permutation_( indexInPass ) );
+
+            count_++;
+        }
+    }
+};
+
+// Unit popularity follows Zipf's law: the k-th most popular is hit in
+// proportion to 1 / k^theta.  The ranks are scattered over the slice
+// by a fixed permutation, so the hot set isn't one contiguous run.
+//
+// Draws use Hoermann and Derflinger's rejection-inversion, which takes
+// O(1) time and memory for any theta >= 0 and any number of units, so
+// there is no zeta(n) table to build over a multi-terabyte target.
+class ZipfAccess : public BatchedAccessGenerator
+{
+    private:
+
+    const double THETA;
+
+    BlockPermutation scatter_;
+
+    double hIntegralX1_;
+    double hIntegralN_;
+    double s_;
+
+    public:
+
+    ZipfAccess( 
+            int64_t sliceStart, 
+            int64_t sliceBytes, 
+            int64_t grain, 
+            uint64_t seed,
+            double theta )
+        : BatchedAccessGenerator( sliceStart, sliceBytes, grain, seed )
+        , THETA( theta )
+        , scatter_( NUM_UNITS, seed )
+    {
+        hIntegralX1_ = hIntegral( 1.5 ) - 1;
+        hIntegralN_ = hIntegral( NUM_UNITS + 0.5 );
+        s_ = 2 - hIntegralInverse( hIntegral( 2.5 ) - h( 2 ) );
+    }
+
+    protected:
+
+    void refill( std::vector<int64_t> &units )
+    {
+        for( auto &u: units )
+        {
+            u = static_cast<int64_t>( scatter_( drawRank() - 1 ) );
+        }
+    }
+
+    private:
+
+    // In [1, NUM_UNITS]
+    int64_t drawRank()
+    {
+        std::uniform_real_distribution<double> uniform( 0, 1 );
+
+        for( ;; )
+        {
+            double u = hIntegralN_ + 
+                uniform( rngEngine_ ) * ( hIntegralX1_ - hIntegralN_ );
+
+            double x = hIntegralInverse( u );
+
+            int64_t k = static_cast<int64_t>( x + 0.5 );
+
+            k = std::min( std::max<int64_t>( k, 1 ), NUM_UNITS );
+
+            if( ( k - x <= s_ ) || ( u >= hIntegral( k + 0.5 ) - h( k ) ) )
+            {
+                return k;
+            }
+        }
+    }
+
+    double h( double x ) const
+    {
+        return std::exp( -THETA * std::log( x ) );
+    }
+
+    double hIntegral( double x ) const
+    {
+        double logX = std::log( x );
+
+        return helper2( ( 1 - THETA ) * logX ) * logX;
+    }
+
+    double hIntegralInverse( double x ) const
+    {
+        double t = std::max( -1.0, x * ( 1 - THETA ) );
+
+        return std::exp( helper1( t ) * x );
+    }
+
+    // log( 1 + x ) / x, without cancellation near 0
+    static double helper1( double x )
+    {
+        if( std::abs( x ) > 1e-8 ) return std::log1p( x ) / x;
+
+        return 1 - x * ( 0.5 - x * ( 1.0 / 3 - 0.25 * x ) );
+    }
+
+    // ( exp( x ) - 1 ) / x, without cancellation near 0
+    static double helper2( double x )
+    {
+        if( std::abs( x ) > 1e-8 ) return std::expm1( x ) / x;
+
+        return 1 + x * 0.5 * ( 1 + x / 3 * ( 1 + 0.25 * x ) );
+    }
+};
+
+// Consecutive bands from the start of the slice, each taking a given
+// share of the IOs, uniformly within it.  Whatever space the bands
+// don't claim is one more band, with whatever share is left over.
+class HotColdAccess : public BatchedAccessGenerator
+{
+    private:
+
+    std::vector<int64_t> bandStart_;
+    std::vector<int64_t> bandUnits_;
+    std::unique_ptr<AliasTable> bandChooser_;
+
+    public:
+
+    // Both in percent, of the slice and of the IOs
+    HotColdAccess( 
+            int64_t sliceStart, 
+            int64_t sliceBytes, 
+            int64_t grain, 
+            uint64_t seed,
+            const std::vector<double> &bandSpace,
+            const std::vector<double> &bandTraffic )
+        : BatchedAccessGenerator( sliceStart, sliceBytes, grain, seed )
+    {
+        std::vector<double> weights;
+
+        double space = 0;
+        double traffic = 0;
+
+        for( size_t i = 0; i <= bandSpace.size(); ++i )
+        {
+            bool isRemainder = ( i == bandSpace.size() );
+
+            int64_t start = llround( space / 100 * NUM_UNITS );
+
+            space = isRemainder ? 100 : space + bandSpace[i];
+
+            int64_t end = llround( space / 100 * NUM_UNITS );
+
+            double share = isRemainder ? 100 - traffic : bandTraffic[i];
+
+            traffic += share;
+
+            // Too small to hold a unit of this slice: no IOs for it
+            bandStart_.push_back( start );
+            bandUnits_.push_back( end - start );
+            weights.push_back( ( end > start ) ? share : 0 );
+        }
+
+        // Every band too small to hit, e.g. a one-unit slice
+        if( std::accumulate( weights.begin(), weights.end(), 0.0 ) <= 0 )
+        {
+            weights.back() = 1;
+            bandStart_.back() = 0;
+            bandUnits_.back() = NUM_UNITS;
+        }
+
+        bandChooser_.reset( new AliasTable( weights ) );
+    }
+
+    protected:
+
+    void refill( std::vector<int64_t> &units )
+    {
+        for( auto &u: units )
+        {
+            size_t band = ( *bandChooser_ )( rngEngine_ );
+
+            std::uniform_int_distribution<int64_t> dist( 
+                0, bandUnits_[band] - 1 );
+
+            u = bandStart_[band] + dist( rngEngine_ );
+        }
+    }
+};
+
+// A normally distributed hotspot whose center moves steadily through
+// the slice, wrapping at the end.  SIGMA and DRIFT are fractions of the
+// slice, and DRIFT is per second.
+class GaussianAccess : public BatchedAccessGenerator
+{
+    private:
+
+    const double SIGMA;
+    const double DRIFT;
+    const int64_t START_TIME;
+
+    public:
+
+    GaussianAccess( 
+            int64_t sliceStart, 
+            int64_t sliceBytes, 
+            int64_t grain, 
+            uint64_t seed,
+            double sigma,
+            double drift )
+        : BatchedAccessGenerator( sliceStart, sliceBytes, grain, seed )
+        , SIGMA( sigma )
+        , DRIFT( drift )
+        , START_TIME( qpc() )
+    {}
+
+    protected:
+
+    void refill( std::vector<int64_t> &units )
+    {
+        // Once per batch is plenty: a batch takes well under a second
+        double seconds = static_cast<double>( qpc() - START_TIME ) / 
+            QPC_TICKS_PER_SEC;
+
+        double center = 0.5 + DRIFT * seconds;
+
+        std::normal_distribution<double> dist( center, SIGMA );
+
+        for( auto &u: units )
+        {
+            double x = dist( rngEngine_ );
+
+            x -= std::floor( x );
+
+            u = std::min( NUM_UNITS - 1, 
+                static_cast<int64_t>( x * NUM_UNITS ) );
+        }
+    }
+};
+
+#endif // __ACCESS_GENERATOR_H_
@@ -0,0 +1,142 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __ALIAS_TABLE_H_
+#define __ALIAS_TABLE_H_
+
+#include <vector>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+
+// Walker's alias method, as constructed by Vose.  Samples from any
+// discrete distribution in O(1): pick a column uniformly, then flip one
+// biased coin to choose between the column's own outcome and its alias.
+// Building the table is O(n), once, up front.
+class AliasTable
+{
+    private:
+
+    std::vector<double> probability_;
+    std::vector<size_t> alias_;
+
+    public:
+
+    // Weights need not sum to anything in particular
+    explicit AliasTable( const std::vector<double> &weights )
+        : probability_( weights.size() )
+        , alias_( weights.size() )
+    {
+        const size_t n = weights.size();
+
+        double total = 0;
+
+        for( auto w: weights )
+        {
+            if( w < 0 ) throw std::invalid_argument( "negative weight" );
+            total += w;
+        }
+
+        if( ( n == 0 ) || ( total <= 0 ) )
+        {
+            throw std::invalid_argument( "no weight" );
+        }
+
+        // Scale so the average column holds exactly 1
+        std::vector<double> scaled( n );
+        std::vector<size_t> small;
+        std::vector<size_t> large;
+
+        for( size_t i = 0; i < n; ++i )
+        {
+            scaled[i] = weights[i] * n / total;
+
+            if( scaled[i] < 1 )
+            {
+                small.push_back( i );
+            }
+            else
+            {
+                large.push_back( i );
+            }
+        }
+
+        // Top up each short column with probability from a tall one
+        while( !small.empty() && !large.empty() )
+        {
+            size_t s = small.back();
+            small.pop_back();
+
+            size_t l = large.back();
+
+            probability_[s] = scaled[s];
+            alias_[s] = l;
+
+            scaled[l] -= 1 - scaled[s];
+
+            if( scaled[l] < 1 )
+            {
+                large.pop_back();
+                small.push_back( l );
+            }
+        }
+
+        // Whatever is left is full, give or take rounding
+        for( auto i: large )
+        {
+            probability_[i] = 1;
+            alias_[i] = i;
+        }
+
+        for( auto i: small )
+        {
+            probability_[i] = 1;
+            alias_[i] = i;
+        }
+    }
+
+    size_t size() const
+    {
+        return probability_.size();
+    }
+
+    // Index of the chosen weight
+    template<typename Engine>
+    size_t operator()( Engine &engine ) const
+    {
+        if( probability_.size() == 1 ) return 0;
+
+        std::uniform_int_distribution<size_t> column( 0, size() - 1 );
+        std::uniform_real_distribution<double> coin( 0, 1 );
+
+        size_t i = column( engine );
+
+        return ( coin( engine ) < probability_[i] ) ? i : alias_[i];
+    }
+};
+
+#endif // __ALIAS_TABLE_H_
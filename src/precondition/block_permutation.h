@@ -0,0 +1,124 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __BLOCK_PERMUTATION_H_
+#define __BLOCK_PERMUTATION_H_
+
+#include <cstdint>
+#include <cassert>
+#include <array>
+
+// A keyed, pseudo-random bijection on [0, numBlocks).
+//
+// Feeding it 0, 1, 2, ... numBlocks - 1 visits every block exactly once,
+// in shuffled order, with O(1) memory.  It is a small Feistel network
+// over the smallest even number of bits that covers numBlocks; results
+// that land past the end are re-encrypted ("cycle walking") until they
+// land inside.  The Feistel domain is < 4x numBlocks, so that averages
+// fewer than 4 rounds of walking.
+//
+// This is not cryptography.  We only need an order the drive can't
+// predict, and that defeats any sequential-stream detection.
+class BlockPermutation
+{
+    private:
+
+    static const int NUM_ROUNDS = 4;
+
+    uint64_t numBlocks_;
+    int halfBits_;
+    uint64_t halfMask_;
+
+    std::array< uint64_t, NUM_ROUNDS > roundKeys_;
+
+    public:
+
+    BlockPermutation( uint64_t numBlocks = 1, uint64_t key = 0 )
+        : numBlocks_( numBlocks )
+        , halfBits_( 0 )
+    {
+        while( ( 1ULL << ( 2 * halfBits_ ) ) < numBlocks_ )
+        {
+            halfBits_++;
+        }
+
+        halfMask_ = ( 1ULL << halfBits_ ) - 1;
+
+        rekey( key );
+    }
+
+    // A different key gives an unrelated order, e.g. one per pass
+    void rekey( uint64_t key )
+    {
+        for( auto &k: roundKeys_ )
+        {
+            key = splitMix64( key );
+            k = key;
+        }
+    }
+
+    uint64_t operator()( uint64_t index ) const
+    {
+        assert( index < numBlocks_ );
+
+        do
+        {
+            index = encrypt( index );
+        }
+        while( index >= numBlocks_ );
+
+        return index;
+    }
+
+    private:
+
+    static uint64_t splitMix64( uint64_t x )
+    {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = ( x ^ ( x >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+        x = ( x ^ ( x >> 27 ) ) * 0x94D049BB133111EBULL;
+        return x ^ ( x >> 31 );
+    }
+
+    uint64_t encrypt( uint64_t x ) const
+    {
+        uint64_t left = x >> halfBits_;
+        uint64_t right = x & halfMask_;
+
+        for( auto &k: roundKeys_ )
+        {
+            uint64_t newRight = left ^ ( splitMix64( right ^ k ) & halfMask_ );
+
+            left = right;
+            right = newRight;
+        }
+
+        return ( left << halfBits_ ) | right;
+    }
+};
+
+#endif // __BLOCK_PERMUTATION_H_
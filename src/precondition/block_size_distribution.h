@@ -0,0 +1,139 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __BLOCK_SIZE_DISTRIBUTION_H_
+#define __BLOCK_SIZE_DISTRIBUTION_H_
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <algorithm>
+
+#include "alias_table.h"
+
+// What size each IO should be: one fixed size (-b), or a weighted mix
+// like fio's bssplit (-B).  Drawing a size is O(1) regardless of how
+// many sizes are in the mix.
+class BlockSizeDistribution
+{
+    private:
+
+    std::vector<int64_t> sizes_;
+    std::vector<double> weights_;
+    AliasTable table_;
+
+    public:
+
+    explicit BlockSizeDistribution( int64_t size )
+        : sizes_( 1, size )
+        , weights_( 1, 1.0 )
+        , table_( weights_ )
+    {}
+
+    BlockSizeDistribution( 
+            const std::vector<int64_t> &sizes, 
+            const std::vector<double> &weights )
+        : sizes_( sizes )
+        , weights_( weights )
+        , table_( weights )
+    {}
+
+    template<typename Engine>
+    int64_t operator()( Engine &engine ) const
+    {
+        return sizes_[ table_( engine ) ];
+    }
+
+    bool isSingleSize() const
+    {
+        return sizes_.size() == 1;
+    }
+
+    int64_t getMaxSize() const
+    {
+        return *std::max_element( sizes_.begin(), sizes_.end() );
+    }
+
+    // Every size is a multiple of this
+    int64_t getGrain() const
+    {
+        int64_t grain = 0;
+
+        for( auto s: sizes_ )
+        {
+            grain = gcd( grain, s );
+        }
+
+        return grain;
+    }
+
+    double getMeanSize() const
+    {
+        double total = 0;
+        double weighted = 0;
+
+        for( size_t i = 0; i < sizes_.size(); ++i )
+        {
+            total += weights_[i];
+            weighted += weights_[i] * sizes_[i];
+        }
+
+        return weighted / total;
+    }
+
+    // e.g. "4/60:64/30:1024/10", in KB
+    std::string toString() const
+    {
+        std::ostringstream msg;
+
+        for( size_t i = 0; i < sizes_.size(); ++i )
+        {
+            if( i > 0 ) msg << ":";
+
+            msg << sizes_[i] / 1024 << "/" << weights_[i];
+        }
+
+        return msg.str();
+    }
+
+    private:
+
+    static int64_t gcd( int64_t a, int64_t b )
+    {
+        while( b != 0 )
+        {
+            int64_t t = a % b;
+            a = b;
+            b = t;
+        }
+
+        return a;
+    }
+};
+
+#endif // __BLOCK_SIZE_DISTRIBUTION_H_
@@ -0,0 +1,288 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __BUFFER_POOL_H_
+#define __BUFFER_POOL_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+#include <boost/utility.hpp>
+
+#include "precondition.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// Part of the pool, shaped enough like a std::array for the buffer
+// fillers in compressible_data.h
+class ByteSpan
+{
+    private:
+
+    uint8_t *data_;
+    size_t size_;
+
+    public:
+
+    ByteSpan( uint8_t *data, size_t size )
+        : data_( data )
+        , size_( size )
+    {}
+
+    uint8_t *begin() const { return data_; }
+    uint8_t *end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    uint8_t &operator[]( size_t i ) const { return data_[i]; }
+};
+
+// Every byte an IO reads into or writes from, in one mapping sized to
+// the run: a write buffer twice the largest IO we support, whatever
+// size this run's IOs are, so writes can start at any of many random
+// offsets, then a slot per outstanding IO.
+//
+// Big pools are backed by huge pages if we can get them, explicit ones
+// or else transparent ones, which spares the TLB and makes pinning the
+// pages for DMA cheaper.  Slots are multiples of MAX_SECTOR_SIZE, so
+// all are aligned for O_DIRECT.
+//
+// Never unmapped: workers may still be running when an error exit()s.
+class BufferPool : boost::noncopyable
+{
+    public:
+
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    static const int64_t WRITE_BUFFER_BYTES = 2 * MAX_IO_SIZE;
+
+    enum PageKind { SMALL_PAGES, TRANSPARENT_HUGE_PAGES, HUGE_PAGES };
+
+    private:
+
+    uint8_t *base_;
+    size_t bytes_;
+    int64_t slotBytes_;
+    PageKind pageKind_;
+    bool locked_;
+
+    public:
+
+    BufferPool()
+        : base_( NULL )
+        , bytes_( 0 )
+        , slotBytes_( 0 )
+        , pageKind_( SMALL_PAGES )
+        , locked_( false )
+    {}
+
+    // Maps the pool without touching it, so the pages can be bound to
+    // a NUMA node before prefault() allocates them
+    void allocate( int64_t maxIOSize, int64_t numSlots )
+    {
+        slotBytes_ = divRoundUp( maxIOSize, MAX_SECTOR_SIZE ) * MAX_SECTOR_SIZE;
+        bytes_ = static_cast<size_t>( 
+            WRITE_BUFFER_BYTES + numSlots * slotBytes_ );
+
+        // Not worth a huge page until we'd fill most of one
+        if( bytes_ >= HUGE_PAGE_SIZE / 2 )
+        {
+            bytes_ = divRoundUp( bytes_, HUGE_PAGE_SIZE ) * HUGE_PAGE_SIZE;
+
+            mapHugePages();
+        }
+
+        if( base_ == NULL ) mapSmallPages();
+
+        if( base_ == NULL )
+        {
+            std::cerr << "Error: couldn't allocate " << bytes_ / 1024 
+                << " KB of IO buffers\n";
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    void prefault()
+    {
+        memset( base_, 0, bytes_ );
+    }
+
+    bool lock()
+    {
+#ifdef _WIN32
+        // Large pages are never paged out anyway
+        locked_ = ( pageKind_ == HUGE_PAGES ) || 
+            ( VirtualLock( base_, bytes_ ) != 0 );
+#else
+        locked_ = ( mlock( base_, bytes_ ) == 0 );
+#endif
+        return locked_;
+    }
+
+    bool isLocked() const
+    {
+        return locked_;
+    }
+
+    uint8_t *getBase() const
+    {
+        return base_;
+    }
+
+    size_t getSize() const
+    {
+        return bytes_;
+    }
+
+    int64_t getSlotBytes() const
+    {
+        return slotBytes_;
+    }
+
+    ByteSpan getWriteBuffer() const
+    {
+        return ByteSpan( base_, WRITE_BUFFER_BYTES );
+    }
+
+    uint8_t *getSlot( int64_t slot ) const
+    {
+        return base_ + WRITE_BUFFER_BYTES + slot * slotBytes_;
+    }
+
+    // All the slots, as one span
+    ByteSpan getSlots() const
+    {
+        return ByteSpan( getSlot( 0 ), bytes_ - WRITE_BUFFER_BYTES );
+    }
+
+    std::string getPageKindName() const
+    {
+        switch( pageKind_ )
+        {
+            case HUGE_PAGES: return "huge pages";
+            case TRANSPARENT_HUGE_PAGES: return "transparent huge pages";
+            default: return "small pages";
+        }
+    }
+
+    private:
+
+#ifdef _WIN32
+    // Large pages need SeLockMemoryPrivilege, which few accounts have
+    void mapHugePages()
+    {
+        size_t largePage = GetLargePageMinimum();
+
+        if( largePage == 0 ) return;
+
+        size_t bytes = divRoundUp( bytes_, largePage ) * largePage;
+
+        base_ = static_cast<uint8_t *>( VirtualAlloc( 
+            NULL, 
+            bytes, 
+            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, 
+            PAGE_READWRITE ) );
+
+        if( base_ != NULL )
+        {
+            bytes_ = bytes;
+            pageKind_ = HUGE_PAGES;
+        }
+    }
+
+    void mapSmallPages()
+    {
+        base_ = static_cast<uint8_t *>( VirtualAlloc( 
+            NULL, bytes_, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ) );
+    }
+#else
+    // Explicit huge pages only exist if someone reserved them
+    void mapHugePages()
+    {
+        void *p = mmap( NULL, bytes_, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+
+        if( p != MAP_FAILED )
+        {
+            base_ = static_cast<uint8_t *>( p );
+            pageKind_ = HUGE_PAGES;
+            return;
+        }
+
+        if( transparentHugePagesEnabled() )
+        {
+            // Over-map, so we can start on a huge page boundary
+            uint8_t *q = static_cast<uint8_t *>( mmap( 
+                NULL, bytes_ + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) );
+
+            if( q == MAP_FAILED ) return;
+
+            uintptr_t aligned = divRoundUp( 
+                reinterpret_cast<uintptr_t>( q ), HUGE_PAGE_SIZE ) * 
+                HUGE_PAGE_SIZE;
+
+            base_ = reinterpret_cast<uint8_t *>( aligned );
+
+            size_t head = base_ - q;
+
+            if( head > 0 ) munmap( q, head );
+            munmap( base_ + bytes_, HUGE_PAGE_SIZE - head );
+
+            if( madvise( base_, bytes_, MADV_HUGEPAGE ) == 0 )
+            {
+                pageKind_ = TRANSPARENT_HUGE_PAGES;
+            }
+        }
+    }
+
+    void mapSmallPages()
+    {
+        void *p = mmap( NULL, bytes_, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+        base_ = ( p == MAP_FAILED ) ? NULL : static_cast<uint8_t *>( p );
+    }
+
+    // "always [madvise] never" lists the choices, and brackets the one
+    // in effect
+    static bool transparentHugePagesEnabled()
+    {
+        std::ifstream file( "/sys/kernel/mm/transparent_hugepage/enabled" );
+        std::string line;
+
+        std::getline( file, line );
+
+        return !line.empty() && ( line.find( "[never]" ) == std::string::npos );
+    }
+#endif
+};
+
+#endif // __BUFFER_POOL_H_
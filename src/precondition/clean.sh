@@ -0,0 +1,2 @@
+#!/bin/sh
+rm -f precondition *.o
@@ -0,0 +1,188 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __COMPRESSIBLE_DATA_H_
+#define __COMPRESSIBLE_DATA_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// Drives with inline compression typically compress each 4K on its own
+const size_t COMPRESSION_CHUNK_SIZE = 4096;
+
+// Size of data after a greedy LZ77 pass, counted the way the LZ4 block
+// format would store it.  That's the family of compressor found in SSD
+// controllers, and it's fast enough to calibrate with at startup.
+// Nothing is written; we only need the size.
+size_t getCompressedSize( const uint8_t *data, size_t size )
+{
+    const int HASH_BITS = 12;
+    const size_t MIN_MATCH = 4;
+    const size_t MAX_OFFSET = 65535;
+    const size_t LAST_LITERALS = 5; // LZ4 ends every block with these
+
+    // Bytes needed to extend a length past its 4-bit nibble
+    auto extraLengthBytes = []( size_t n )
+    {
+        return ( n >= 15 ) ? ( n - 15 ) / 255 + 1 : 0;
+    };
+
+    // token + literals + offset + match length
+    auto sequenceSize = [&]( size_t literals, size_t matchLength )
+    {
+        return 1 + literals + extraLengthBytes( literals ) + 
+            2 + extraLengthBytes( matchLength - MIN_MATCH );
+    };
+
+    std::vector<int64_t> table( 1 << HASH_BITS, -1 );
+
+    size_t compressedSize = 0;
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    const size_t limit = ( size > LAST_LITERALS ) ? size - LAST_LITERALS : 0;
+
+    while( pos + MIN_MATCH <= limit )
+    {
+        uint32_t sequence;
+        memcpy( &sequence, data + pos, sizeof( sequence ) );
+
+        uint32_t hash = ( sequence * 2654435761u ) >> ( 32 - HASH_BITS );
+
+        int64_t candidate = table[hash];
+        table[hash] = pos;
+
+        if( ( candidate >= 0 ) && ( pos - candidate <= MAX_OFFSET ) &&
+                ( memcmp( data + candidate, data + pos, MIN_MATCH ) == 0 ) )
+        {
+            size_t matchLength = MIN_MATCH;
+
+            while( ( pos + matchLength < limit ) && 
+                ( data[candidate + matchLength] == data[pos + matchLength] ) )
+            {
+                ++matchLength;
+            }
+
+            compressedSize += sequenceSize( pos - anchor, matchLength );
+
+            pos += matchLength;
+            anchor = pos;
+        }
+        else
+        {
+            ++pos;
+        }
+    }
+
+    // Trailing literals get a token of their own
+    size_t literals = size - anchor;
+
+    compressedSize += 1 + literals + extraLengthBytes( literals );
+
+    return compressedSize;
+}
+
+// Percentage of the buffer compression would save, chunk by chunk.
+// Chunks that would grow are stored as-is, as a drive would.
+template<typename T>
+double measureCompressibility( const T& buffer )
+{
+    size_t compressed = 0;
+    size_t total = 0;
+
+    for( size_t i = 0; i + COMPRESSION_CHUNK_SIZE <= buffer.size();
+            i += COMPRESSION_CHUNK_SIZE )
+    {
+        compressed += std::min( COMPRESSION_CHUNK_SIZE,
+            getCompressedSize( &buffer[i], COMPRESSION_CHUNK_SIZE ) );
+
+        total += COMPRESSION_CHUNK_SIZE;
+    }
+
+    return ( total > 0 ) ? 100.0 * ( total - compressed ) / total : 0;
+}
+
+// Random data with the first zeroBytes of every chunk cleared
+template<typename T>
+void fillChunks( T& buffer, size_t zeroBytes )
+{
+    randomFillBuffer( buffer );
+
+    for( size_t i = 0; i < buffer.size(); i += COMPRESSION_CHUNK_SIZE )
+    {
+        size_t n = std::min( zeroBytes, buffer.size() - i );
+
+        std::fill_n( buffer.begin() + i, n, 0 );
+    }
+}
+
+// Fills buffer so that it is percentCompressible percent compressible,
+// and returns what we actually measured.
+//
+// Compressibility.pm does this with a hand-fitted line relating zeros
+// to compression ratio.  Instead, we search for the right number of
+// zeros per chunk against a sample compressed with the real thing.
+template<typename T>
+double fillCompressibleBuffer( T& buffer, int percentCompressible )
+{
+    if( percentCompressible <= 0 )
+    {
+        randomFillBuffer( buffer );
+        return measureCompressibility( buffer );
+    }
+
+    // 64 chunks is plenty to average out the random part
+    std::vector<uint8_t> sample( 64 * COMPRESSION_CHUNK_SIZE );
+
+    size_t low = 0;
+    size_t high = COMPRESSION_CHUNK_SIZE;
+
+    // More zeros never compresses worse, so bisect
+    while( low < high )
+    {
+        size_t zeroBytes = ( low + high ) / 2;
+
+        fillChunks( sample, zeroBytes );
+
+        if( measureCompressibility( sample ) < percentCompressible )
+        {
+            low = zeroBytes + 1;
+        }
+        else
+        {
+            high = zeroBytes;
+        }
+    }
+
+    fillChunks( buffer, low );
+
+    return measureCompressibility( buffer );
+}
+
+#endif // __COMPRESSIBLE_DATA_H_
@@ -0,0 +1,276 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __CRC32C_H_
+#define __CRC32C_H_
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined( _M_X64 ) || defined( __x86_64__ )
+#define CRC32C_X86 1
+#include <nmmintrin.h>
+#endif
+
+#if defined( _MSC_VER ) && defined( CRC32C_X86 )
+#include <intrin.h>
+#endif
+
+#if defined( __ARM_FEATURE_CRC32 )
+#define CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+#if defined( CRC32C_X86 ) && !defined( _MSC_VER )
+#define TARGET_SSE42 __attribute__(( target( "sse4.2" ) ))
+#else
+#define TARGET_SSE42
+#endif
+
+// CRC32C (Castagnoli), the checksum iSCSI, ext4 and btrfs use, and the
+// one x86 (SSE4.2) and ARMv8 compute in hardware.
+//
+// crc32cBlocks() checks many equal-sized blocks at once.  The CRC
+// instruction has a latency of three cycles but can start one every
+// cycle, so working on three independent blocks side by side keeps it
+// busy and triples throughput over doing them one at a time.
+namespace crc32c_detail
+{
+    const uint32_t POLYNOMIAL = 0x82F63B78; // reflected
+
+    struct Table
+    {
+        uint32_t entries[256];
+
+        Table()
+        {
+            for( uint32_t i = 0; i < 256; ++i )
+            {
+                uint32_t crc = i;
+
+                for( int bit = 0; bit < 8; ++bit )
+                {
+                    crc = ( crc >> 1 ) ^ ( ( crc & 1 ) ? POLYNOMIAL : 0 );
+                }
+
+                entries[i] = crc;
+            }
+        }
+    };
+
+    inline uint32_t updateSoftware( 
+            uint32_t crc, const uint8_t *data, size_t bytes )
+    {
+        static const Table table;
+
+        for( size_t i = 0; i < bytes; ++i )
+        {
+            crc = ( crc >> 8 ) ^ table.entries[( crc ^ data[i] ) & 0xFF];
+        }
+
+        return crc;
+    }
+
+    typedef void (*BlocksKernel)( 
+        const uint8_t *, size_t, size_t, int64_t, uint32_t * );
+
+    inline void blocksSoftware( 
+            const uint8_t *first, 
+            size_t stride, 
+            size_t bytes, 
+            int64_t count, 
+            uint32_t *crcs )
+    {
+        for( int64_t i = 0; i < count; ++i )
+        {
+            crcs[i] = ~updateSoftware( ~0U, first + i * stride, bytes );
+        }
+    }
+
+#if defined( CRC32C_X86 ) || defined( CRC32C_ARM )
+
+#ifdef CRC32C_X86
+    TARGET_SSE42
+    inline uint64_t step64( uint64_t crc, const uint8_t *p )
+    {
+        uint64_t v;
+        memcpy( &v, p, sizeof( v ) );
+        return _mm_crc32_u64( crc, v );
+    }
+
+    TARGET_SSE42
+    inline uint64_t step8( uint64_t crc, const uint8_t *p )
+    {
+        return _mm_crc32_u8( static_cast<uint32_t>( crc ), *p );
+    }
+#else
+    inline uint64_t step64( uint64_t crc, const uint8_t *p )
+    {
+        uint64_t v;
+        memcpy( &v, p, sizeof( v ) );
+        return __crc32cd( static_cast<uint32_t>( crc ), v );
+    }
+
+    inline uint64_t step8( uint64_t crc, const uint8_t *p )
+    {
+        return __crc32cb( static_cast<uint32_t>( crc ), *p );
+    }
+#endif
+
+    TARGET_SSE42
+    inline uint32_t updateHardware( 
+            uint32_t crc32, const uint8_t *data, size_t bytes )
+    {
+        uint64_t crc = crc32;
+        size_t i = 0;
+
+        for( ; i + 8 <= bytes; i += 8 )
+        {
+            crc = step64( crc, data + i );
+        }
+
+        for( ; i < bytes; ++i )
+        {
+            crc = step8( crc, data + i );
+        }
+
+        return static_cast<uint32_t>( crc );
+    }
+
+    TARGET_SSE42
+    void blocksHardware( 
+            const uint8_t *first, 
+            size_t stride, 
+            size_t bytes, 
+            int64_t count, 
+            uint32_t *crcs )
+    {
+        int64_t i = 0;
+
+        for( ; i + 3 <= count; i += 3 )
+        {
+            const uint8_t *a = first + i * stride;
+            const uint8_t *b = a + stride;
+            const uint8_t *c = b + stride;
+
+            uint64_t crcA = ~0U;
+            uint64_t crcB = ~0U;
+            uint64_t crcC = ~0U;
+
+            size_t j = 0;
+
+            for( ; j + 8 <= bytes; j += 8 )
+            {
+                crcA = step64( crcA, a + j );
+                crcB = step64( crcB, b + j );
+                crcC = step64( crcC, c + j );
+            }
+
+            for( ; j < bytes; ++j )
+            {
+                crcA = step8( crcA, a + j );
+                crcB = step8( crcB, b + j );
+                crcC = step8( crcC, c + j );
+            }
+
+            crcs[i] = ~static_cast<uint32_t>( crcA );
+            crcs[i + 1] = ~static_cast<uint32_t>( crcB );
+            crcs[i + 2] = ~static_cast<uint32_t>( crcC );
+        }
+
+        for( ; i < count; ++i )
+        {
+            crcs[i] = ~updateHardware( ~0U, first + i * stride, bytes );
+        }
+    }
+#endif
+
+    inline bool cpuHasCrc32c()
+    {
+#if defined( CRC32C_ARM )
+        return true; // Known at compile time
+#elif defined( CRC32C_X86 ) && defined( _MSC_VER )
+        int info[4];
+        __cpuid( info, 1 );
+        return ( info[2] & ( 1 << 20 ) ) != 0;
+#elif defined( CRC32C_X86 )
+        return __builtin_cpu_supports( "sse4.2" );
+#else
+        return false;
+#endif
+    }
+
+    struct Kernel
+    {
+        BlocksKernel blocks;
+        const char *name;
+    };
+
+    // Picked once, on first use
+    inline const Kernel &getKernel()
+    {
+        static const Kernel kernel = []()
+        {
+#if defined( CRC32C_X86 )
+            if( cpuHasCrc32c() ) return Kernel{ blocksHardware, "sse4.2" };
+#elif defined( CRC32C_ARM )
+            return Kernel{ blocksHardware, "armv8" };
+#endif
+            return Kernel{ blocksSoftware, "software" };
+        }();
+
+        return kernel;
+    }
+}
+
+const char *getCrc32cKernelName()
+{
+    return crc32c_detail::getKernel().name;
+}
+
+// CRC of the bytes at first, first + stride, ... first + (count-1) * stride
+void crc32cBlocks( 
+        const uint8_t *first, 
+        size_t stride, 
+        size_t bytes, 
+        int64_t count, 
+        uint32_t *crcs )
+{
+    crc32c_detail::getKernel().blocks( first, stride, bytes, count, crcs );
+}
+
+uint32_t crc32c( const void *data, size_t bytes )
+{
+    uint32_t crc;
+
+    crc32cBlocks( static_cast<const uint8_t *>( data ), 0, bytes, 1, &crc );
+
+    return crc;
+}
+
+#endif // __CRC32C_H_
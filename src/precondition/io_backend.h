@@ -0,0 +1,115 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __IO_BACKEND_H_
+#define __IO_BACKEND_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <boost/utility.hpp>
+
+struct IORequest
+{
+    int64_t slot; // [0, queue depth), handed back in the IOCompletion
+    bool isWrite;
+    bool isDiscard; // Deallocate the range; isWrite and buffer are unused
+    void *buffer;
+    int64_t bytes;
+    int64_t offset;
+};
+
+struct IOCompletion
+{
+    int64_t slot;
+    int64_t bytes;
+    int error; // GetLastError() or errno, 0 on success
+};
+
+// Everything IOGenerator needs from the OS.
+//
+// Each instance is driven by exactly one thread, so implementations
+// need not be thread safe.  A slot is never resubmitted until its
+// completion has been returned by reap().
+class IOBackend : boost::noncopyable
+{
+    public:
+
+    virtual ~IOBackend() {}
+
+    virtual std::string getName() const = 0;
+
+    virtual void openTarget( const std::string& targetName, bool rawDisk ) = 0;
+    virtual void closeTarget() = 0;
+    virtual int64_t getTargetSize() = 0;
+    virtual TargetGeometry getTargetGeometry() = 0;
+
+    // Lets the backend map the buffers for DMA once, up front, rather
+    // than on every IO.  Returns whether it did.  Every IO buffer must
+    // then lie within them.
+    virtual bool registerBuffers( void * /* base */, size_t /* bytes */ )
+    {
+        return false;
+    }
+
+    // For -P.  How the backend can have the device polled for
+    // completions, e.g. "io_uring IOPOLL", or empty if it can't.  The
+    // caller then spins on reap() itself.  Only valid once the target
+    // is open.
+    virtual std::string getKernelPolling() const
+    {
+        return "";
+    }
+
+    // Switches between polled and interrupt-driven completion.  Only
+    // called with nothing in flight.
+    virtual void setKernelPolling( bool /* enable */ ) {}
+
+    // Queue an IO.  It may not reach the device until the next reap().
+    virtual void submit( const IORequest& request ) = 0;
+
+    static const int64_t WAIT_FOREVER = -1;
+
+    // Push any queued IOs to the device, then block until at least
+    // minCompletions have completed (or everything in flight, if that's
+    // fewer) or the timeout passes, whichever is first.  Completions
+    // are appended to the vector, along with any others already there;
+    // returns 0 on timeout.  Only legal while IOs are in flight.
+    virtual size_t reap(
+        std::vector<IOCompletion>& completions,
+        int64_t timeoutNanoseconds = WAIT_FOREVER,
+        size_t minCompletions = 1 ) = 0;
+
+    // Abandon everything in flight.  Returns once nothing is outstanding;
+    // the completions of cancelled IOs are discarded.
+    virtual void cancel() = 0;
+
+    virtual void flush() = 0;
+};
+
+#endif // __IO_BACKEND_H_
@@ -0,0 +1,758 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __IO_URING_BACKEND_H_
+#define __IO_URING_BACKEND_H_
+
+#ifdef __linux__
+
+#include <cstdlib>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "precondition.h"
+#include "io_backend.h"
+
+// Talks to the kernel directly rather than through liburing, so the tool
+// has no dependencies beyond the kernel headers.
+//
+// Submissions are only queued by submit().  They reach the kernel in one
+// io_uring_enter per reap(), along with the wait for completions, so the
+// syscall cost is per batch rather than per IO.
+//
+// Discards of a file are punched holes, as asynchronous as any write.
+// io_uring has no portable way to discard a block device, so those are
+// a BLKDISCARD in submit(), and the IOs already in flight on this
+// thread wait that long to be reaped.
+//
+// With -P we keep a second ring that polls the device (IOPOLL) instead
+// of waiting for its interrupts, and where the kernel allows, has its
+// own kernel thread submit and poll for us (SQPOLL), so reaping is just
+// watching the completion queue.  The caller switches between the two
+// rings with nothing in flight, to compare them.
+class IoUringBackend : public IOBackend
+{
+    private:
+
+    // Tags our own IORING_OP_ASYNC_CANCEL, which is not an IO slot
+    static const uint64_t CANCEL_USER_DATA = ~0ULL;
+
+    // How long an SQPOLL thread spins without work before it sleeps
+    static const unsigned SQ_THREAD_IDLE_MS = 50;
+
+    // One io_uring instance, and our view of the memory it shares
+    struct Ring
+    {
+        int fd;
+        unsigned flags; // IORING_SETUP_*
+
+        void *sqRing;
+        void *cqRing;
+        size_t sqRingSize;
+        size_t cqRingSize;
+
+        unsigned *sqTail;
+        unsigned *sqMask;
+        unsigned *sqArray;
+        unsigned *sqFlags;
+
+        unsigned *cqHead;
+        unsigned *cqTail;
+        unsigned *cqMask;
+
+        io_uring_sqe *sqes;
+        size_t sqesSize;
+
+        io_uring_cqe *cqes;
+
+        unsigned toSubmit;
+        int64_t inFlight;
+
+        // Kernels before 5.11 can't take a timeout on io_uring_enter
+        bool hasTimedWait;
+
+        // IOs use READ_FIXED and WRITE_FIXED on buffer 0, once registered
+        bool hasFixedBuffers;
+
+        Ring()
+            : fd( -1 )
+            , flags( 0 )
+            , toSubmit( 0 )
+            , inFlight( 0 )
+            , hasTimedWait( false )
+            , hasFixedBuffers( false )
+        {}
+
+        bool isOpen() const
+        {
+            return fd >= 0;
+        }
+
+        bool isIOPolled() const
+        {
+            return ( flags & IORING_SETUP_IOPOLL ) != 0;
+        }
+
+        bool isSQPolled() const
+        {
+            return ( flags & IORING_SETUP_SQPOLL ) != 0;
+        }
+
+        // Returns 0, or the errno io_uring_setup failed with
+        int setup( unsigned entries, unsigned setupFlags )
+        {
+            using namespace std;
+
+            io_uring_params p;
+            memset( &p, 0, sizeof( p ) );
+
+            p.flags = setupFlags;
+            p.sq_thread_idle = SQ_THREAD_IDLE_MS;
+
+            fd = static_cast<int>( 
+                syscall( __NR_io_uring_setup, entries, &p ) );
+
+            if( fd < 0 ) return errno;
+
+            // Before 5.11 an SQPOLL ring only takes registered files
+            if( ( setupFlags & IORING_SETUP_SQPOLL ) && 
+                    !( p.features & IORING_FEAT_SQPOLL_NONFIXED ) )
+            {
+                ::close( fd );
+                fd = -1;
+
+                return EINVAL;
+            }
+
+            flags = setupFlags;
+
+            sqRingSize = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+            cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof( io_uring_cqe );
+
+            if( p.features & IORING_FEAT_SINGLE_MMAP )
+            {
+                sqRingSize = cqRingSize = max( sqRingSize, cqRingSize );
+            }
+
+            sqRing = checkedMmap( sqRingSize, IORING_OFF_SQ_RING );
+
+            cqRing = ( p.features & IORING_FEAT_SINGLE_MMAP ) ?
+                sqRing :
+                checkedMmap( cqRingSize, IORING_OFF_CQ_RING );
+
+            sqesSize = p.sq_entries * sizeof( io_uring_sqe );
+
+            sqes = static_cast<io_uring_sqe*>(
+                checkedMmap( sqesSize, IORING_OFF_SQES ) );
+
+            uint8_t *sq = static_cast<uint8_t*>( sqRing );
+            uint8_t *cq = static_cast<uint8_t*>( cqRing );
+
+            sqTail = reinterpret_cast<unsigned*>( sq + p.sq_off.tail );
+            sqMask = reinterpret_cast<unsigned*>( sq + p.sq_off.ring_mask );
+            sqArray = reinterpret_cast<unsigned*>( sq + p.sq_off.array );
+            sqFlags = reinterpret_cast<unsigned*>( sq + p.sq_off.flags );
+
+            cqHead = reinterpret_cast<unsigned*>( cq + p.cq_off.head );
+            cqTail = reinterpret_cast<unsigned*>( cq + p.cq_off.tail );
+            cqMask = reinterpret_cast<unsigned*>( cq + p.cq_off.ring_mask );
+            cqes = reinterpret_cast<io_uring_cqe*>( cq + p.cq_off.cqes );
+
+            hasTimedWait = ( p.features & IORING_FEAT_EXT_ARG ) != 0;
+
+            return 0;
+        }
+
+        void close()
+        {
+            if( !isOpen() ) return;
+
+            munmap( sqes, sqesSize );
+
+            if( cqRing != sqRing )
+            {
+                munmap( cqRing, cqRingSize );
+            }
+
+            munmap( sqRing, sqRingSize );
+
+            ::close( fd );
+            fd = -1;
+        }
+
+        void *checkedMmap( size_t length, off_t offset )
+        {
+            using namespace std;
+
+            void *p = mmap(
+                NULL,
+                length,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,
+                fd,
+                offset );
+
+            if( p == MAP_FAILED )
+            {
+                cerr << "mmap of io_uring failed. errno = " << errno << endl;
+
+                exit( EXIT_FAILURE );
+            }
+
+            return p;
+        }
+
+        void queueSqe( const io_uring_sqe& sqe )
+        {
+            // We are the only producer, so no need for an atomic load
+            unsigned tail = *sqTail;
+            unsigned index = tail & *sqMask;
+
+            sqes[index] = sqe;
+            sqArray[index] = index;
+
+            // The kernel must not see the new tail before the SQE itself
+            __atomic_store_n( sqTail, tail + 1, __ATOMIC_RELEASE );
+
+            toSubmit++;
+        }
+
+        unsigned getCompletionCount() const
+        {
+            return __atomic_load_n( cqTail, __ATOMIC_ACQUIRE ) - *cqHead;
+        }
+
+        void enter( unsigned minComplete )
+        {
+            using namespace std;
+
+            unsigned enterFlags = IORING_ENTER_GETEVENTS;
+
+            // Harmless if the SQ thread is already awake
+            if( isSQPolled() ) enterFlags |= IORING_ENTER_SQ_WAKEUP;
+
+            for( ;; )
+            {
+                int retVal = static_cast<int>( syscall( 
+                    __NR_io_uring_enter,
+                    fd,
+                    toSubmit,
+                    minComplete,
+                    enterFlags,
+                    NULL,
+                    0 ) );
+
+                if( retVal >= 0 )
+                {
+                    toSubmit -= retVal;
+                    return;
+                }
+
+                if( errno == EINTR ) continue;
+
+                cerr << "io_uring_enter failed. errno = " << errno << endl;
+
+                exit( EXIT_FAILURE );
+            }
+        }
+
+        // Like enter( 1 ), but gives up after the timeout
+        void enterWithTimeout( 
+                int64_t timeoutNanoseconds, 
+                unsigned minComplete )
+        {
+            using namespace std;
+
+            // IOPOLL waits ignore the timeout, and spin until something
+            // completes, so poll one pass at a time instead
+            if( !hasTimedWait || isIOPolled() )
+            {
+                // Submit, then poll.  Coarse, but only old kernels 
+                // sleep here.
+                int64_t deadline = qpc() + 
+                    timeoutNanoseconds * QPC_TICKS_PER_SEC / 1000000000LL;
+
+                do
+                {
+                    enter( 0 );
+
+                    if( getCompletionCount() >= minComplete ) return;
+
+                    if( !isIOPolled() )
+                    {
+                        this_thread::sleep_for( chrono::microseconds( 20 ) );
+                    }
+                }
+                while( qpc() < deadline );
+
+                return;
+            }
+
+            __kernel_timespec ts;
+            ts.tv_sec = timeoutNanoseconds / 1000000000LL;
+            ts.tv_nsec = timeoutNanoseconds % 1000000000LL;
+
+            io_uring_getevents_arg arg;
+            memset( &arg, 0, sizeof( arg ) );
+            arg.ts = reinterpret_cast<uintptr_t>( &ts );
+
+            for( ;; )
+            {
+                int retVal = static_cast<int>( syscall( 
+                    __NR_io_uring_enter,
+                    fd,
+                    toSubmit,
+                    minComplete,
+                    IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                    &arg,
+                    sizeof( arg ) ) );
+
+                if( retVal >= 0 )
+                {
+                    toSubmit -= retVal;
+                    return;
+                }
+
+                if( errno == ETIME ) return;
+                if( errno == EINTR ) continue;
+
+                cerr << "io_uring_enter failed. errno = " << errno << endl;
+
+                exit( EXIT_FAILURE );
+            }
+        }
+
+        // With SQPOLL, the kernel thread takes queued SQEs by itself.
+        // We only need a syscall if it has gone to sleep.
+        void wakeSQThread()
+        {
+            // Our tail store must be visible before we read its flags
+            __atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+            if( __atomic_load_n( sqFlags, __ATOMIC_RELAXED ) & 
+                    IORING_SQ_NEED_WAKEUP )
+            {
+                enter( 0 );
+            }
+
+            toSubmit = 0;
+        }
+
+        // The SQ thread both submits and polls for us, so waiting is
+        // just watching for the completion queue's tail to move
+        void spinForCompletions( 
+                int64_t timeoutNanoseconds, 
+                unsigned minComplete )
+        {
+            using namespace std;
+
+            int64_t deadline = qpc() + 
+                timeoutNanoseconds * QPC_TICKS_PER_SEC / 1000000000LL;
+
+            while( getCompletionCount() < minComplete )
+            {
+                if( ( timeoutNanoseconds != WAIT_FOREVER ) && 
+                        ( qpc() >= deadline ) )
+                {
+                    return;
+                }
+
+                // Let the SQ thread have the core, if it's on ours
+                this_thread::yield();
+
+                wakeSQThread();
+            }
+        }
+
+        size_t drainCompletionQueue( std::vector<IOCompletion> *completions )
+        {
+            // We are the only consumer, so no need for an atomic load
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n( cqTail, __ATOMIC_ACQUIRE );
+
+            size_t numReaped = 0;
+
+            for( ; head != tail; ++head )
+            {
+                const io_uring_cqe &cqe = cqes[head & *cqMask];
+
+                if( cqe.user_data == CANCEL_USER_DATA ) continue;
+
+                inFlight--;
+
+                if( completions == NULL ) continue;
+
+                IOCompletion completion;
+
+                completion.slot = static_cast<int64_t>( cqe.user_data );
+                completion.bytes = ( cqe.res < 0 ) ? 0 : cqe.res;
+                completion.error = ( cqe.res < 0 ) ? -cqe.res : 0;
+
+                completions->push_back( completion );
+
+                numReaped++;
+            }
+
+            __atomic_store_n( cqHead, head, __ATOMIC_RELEASE );
+
+            return numReaped;
+        }
+    };
+
+    int targetFd_;
+    bool blockDevice_;
+
+    Ring ring_;
+    Ring pollRing_; // Open only with -P, and only if the target can poll
+    Ring *active_; // Whichever of the two we are using
+
+    // Discards we did synchronously, waiting for the next reap()
+    std::vector< IOCompletion > doneInline_;
+
+    public:
+
+    IoUringBackend( int64_t queueDepth, bool polled )
+        : targetFd_( -1 )
+        , blockDevice_( false )
+        , active_( &ring_ )
+    {
+        using namespace std;
+
+        // One spare entry for the cancel request
+        unsigned entries = static_cast<unsigned>( queueDepth + 1 );
+
+        int error = ring_.setup( entries, 0 );
+
+        if( error != 0 )
+        {
+            cerr << "io_uring_setup failed. errno = " 
+                << error << " (" << strerror( error ) << ")" << endl;
+
+            if( ( error == ENOSYS ) || ( error == EPERM ) )
+            {
+                cerr << "Is io_uring disabled or blocked by seccomp?"
+                    << endl;
+            }
+
+            exit( EXIT_FAILURE );
+        }
+
+        if( polled )
+        {
+            // SQPOLL needs CAP_SYS_NICE before 5.11
+            if( pollRing_.setup( entries, 
+                    IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL ) != 0 )
+            {
+                pollRing_.setup( entries, IORING_SETUP_IOPOLL );
+            }
+        }
+    }
+
+    ~IoUringBackend()
+    {
+        pollRing_.close();
+        ring_.close();
+    }
+
+    static bool isSupported()
+    {
+        io_uring_params p;
+        memset( &p, 0, sizeof( p ) );
+
+        int fd = static_cast<int>( syscall( __NR_io_uring_setup, 1, &p ) );
+
+        if( fd < 0 ) return false;
+
+        close( fd );
+
+        return true;
+    }
+
+    std::string getName() const
+    {
+        return "io_uring";
+    }
+
+    void openTarget( const std::string& targetName, bool /* rawDisk */ )
+    {
+        targetFd_ = checkedOpenTarget( targetName );
+        blockDevice_ = isBlockDevice( targetFd_ );
+
+        // Only block devices with poll queues, and the files on them,
+        // can be polled.  The rest fail every IO with EOPNOTSUPP.
+        if( pollRing_.isOpen() && !probePolling() )
+        {
+            pollRing_.close();
+        }
+    }
+
+    void closeTarget()
+    {
+        close( targetFd_ );
+        targetFd_ = -1;
+    }
+
+    int64_t getTargetSize()
+    {
+        return checkedGetTargetSize( targetFd_ );
+    }
+
+    TargetGeometry getTargetGeometry()
+    {
+        return queryTargetGeometry( targetFd_ );
+    }
+
+    // One iovec covering the whole pool.  The kernel pins its pages
+    // now, instead of on every IO.
+    bool registerBuffers( void *base, size_t bytes )
+    {
+        if( pollRing_.isOpen() )
+        {
+            registerBuffers( pollRing_, base, bytes );
+        }
+
+        return registerBuffers( ring_, base, bytes );
+    }
+
+    std::string getKernelPolling() const
+    {
+        if( !pollRing_.isOpen() ) return "";
+
+        return pollRing_.isSQPolled() ? 
+            "io_uring IOPOLL+SQPOLL" : "io_uring IOPOLL";
+    }
+
+    void setKernelPolling( bool enable )
+    {
+        assert( ( ring_.inFlight == 0 ) && ( pollRing_.inFlight == 0 ) );
+        assert( doneInline_.empty() );
+
+        active_ = ( enable && pollRing_.isOpen() ) ? &pollRing_ : &ring_;
+    }
+
+    void submit( const IORequest& request )
+    {
+        Ring &ring = *active_;
+
+        // IOPOLL rings take nothing but reads and writes
+        if( request.isDiscard && ( blockDevice_ || ring.isIOPolled() ) )
+        {
+            IOCompletion completion;
+
+            completion.slot = request.slot;
+            completion.error = discardRange( 
+                targetFd_, blockDevice_, request.offset, request.bytes );
+            completion.bytes = ( completion.error == 0 ) ? request.bytes : 0;
+
+            doneInline_.push_back( completion );
+
+            return;
+        }
+
+        io_uring_sqe sqe;
+        memset( &sqe, 0, sizeof( sqe ) );
+
+        sqe.fd = targetFd_;
+        sqe.off = request.offset;
+        sqe.user_data = request.slot;
+
+        if( request.isDiscard )
+        {
+            // For fallocate, addr is the length and len the mode
+            sqe.opcode = IORING_OP_FALLOCATE;
+            sqe.addr = request.bytes;
+            sqe.len = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+        }
+        else if( ring.hasFixedBuffers )
+        {
+            sqe.opcode = request.isWrite ? 
+                IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe.addr = reinterpret_cast<uintptr_t>( request.buffer );
+            sqe.len = static_cast<uint32_t>( request.bytes );
+            sqe.buf_index = 0;
+        }
+        else
+        {
+            sqe.opcode = request.isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe.addr = reinterpret_cast<uintptr_t>( request.buffer );
+            sqe.len = static_cast<uint32_t>( request.bytes );
+        }
+
+        ring.queueSqe( sqe );
+
+        ring.inFlight++;
+    }
+
+    size_t reap(
+        std::vector<IOCompletion>& completions,
+        int64_t timeoutNanoseconds,
+        size_t minCompletions )
+    {
+        Ring &ring = *active_;
+
+        assert( ( ring.inFlight > 0 ) || !doneInline_.empty() );
+
+        size_t numReaped = doneInline_.size();
+
+        completions.insert( 
+            completions.end(), doneInline_.begin(), doneInline_.end() );
+
+        doneInline_.clear();
+
+        numReaped += ring.drainCompletionQueue( &completions );
+
+        // The completion queue is empty now, so this is how many more
+        // must arrive
+        unsigned needed = ( numReaped < minCompletions ) ?
+            static_cast<unsigned>( std::min<int64_t>( 
+                minCompletions - numReaped, ring.inFlight ) ) : 0;
+
+        // Submit and wait in the same syscall, unless we already have
+        // enough completions to hand back and nothing to submit.
+        if( ( needed > 0 ) || ( ring.toSubmit > 0 ) )
+        {
+            if( ring.isSQPolled() )
+            {
+                ring.wakeSQThread();
+
+                if( needed > 0 )
+                {
+                    ring.spinForCompletions( timeoutNanoseconds, needed );
+                }
+            }
+            else if( ( needed == 0 ) || 
+                    ( timeoutNanoseconds == WAIT_FOREVER ) )
+            {
+                ring.enter( needed );
+            }
+            else
+            {
+                ring.enterWithTimeout( timeoutNanoseconds, needed );
+            }
+
+            numReaped += ring.drainCompletionQueue( &completions );
+        }
+
+        return numReaped;
+    }
+
+    void cancel()
+    {
+        Ring &ring = *active_;
+
+        doneInline_.clear();
+
+        if( ring.inFlight > 0 )
+        {
+            io_uring_sqe sqe;
+            memset( &sqe, 0, sizeof( sqe ) );
+
+            // Kernels older than 5.19 reject CANCEL_ANY, and IOPOLL rings
+            // any cancel.  That's fine, we just end up waiting for
+            // everything to finish instead.
+            sqe.opcode = IORING_OP_ASYNC_CANCEL;
+            sqe.fd = -1;
+            sqe.cancel_flags = IORING_ASYNC_CANCEL_ANY;
+            sqe.user_data = CANCEL_USER_DATA;
+
+            ring.queueSqe( sqe );
+        }
+
+        while( ( ring.inFlight > 0 ) || ( ring.toSubmit > 0 ) )
+        {
+            ring.enter( ring.inFlight > 0 ? 1 : 0 );
+
+            ring.drainCompletionQueue( NULL );
+        }
+    }
+
+    void flush()
+    {
+        checkedFsync( targetFd_ );
+    }
+
+    private:
+
+    bool registerBuffers( Ring &ring, void *base, size_t bytes )
+    {
+        iovec iov;
+        iov.iov_base = base;
+        iov.iov_len = bytes;
+
+        ring.hasFixedBuffers = ( syscall( 
+            __NR_io_uring_register, 
+            ring.fd, 
+            IORING_REGISTER_BUFFERS, 
+            &iov, 
+            1 ) == 0 );
+
+        return ring.hasFixedBuffers;
+    }
+
+    // Reads the first sector through the polled ring
+    bool probePolling()
+    {
+        void *buffer = NULL;
+
+        if( posix_memalign( &buffer, MAX_SECTOR_SIZE, MAX_SECTOR_SIZE ) != 0 )
+        {
+            return false;
+        }
+
+        io_uring_sqe sqe;
+        memset( &sqe, 0, sizeof( sqe ) );
+
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = targetFd_;
+        sqe.off = 0;
+        sqe.addr = reinterpret_cast<uintptr_t>( buffer );
+        sqe.len = static_cast<uint32_t>( 
+            queryTargetGeometry( targetFd_ ).logicalSectorSize );
+        sqe.user_data = 0;
+
+        pollRing_.queueSqe( sqe );
+        pollRing_.inFlight++;
+
+        std::vector<IOCompletion> completions;
+
+        while( pollRing_.inFlight > 0 )
+        {
+            pollRing_.enter( 1 );
+            pollRing_.drainCompletionQueue( &completions );
+        }
+
+        free( buffer );
+
+        return ( completions.size() == 1 ) && ( completions[0].error == 0 );
+    }
+};
+
+#endif // __linux__
+#endif // __IO_URING_BACKEND_H_
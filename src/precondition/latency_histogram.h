@@ -0,0 +1,311 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __LATENCY_HISTOGRAM_H_
+#define __LATENCY_HISTOGRAM_H_
+
+#include <cstdint>
+#include <cassert>
+#include <cmath>
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Fixed-size log-linear histogram of latencies in nanoseconds.
+//
+// Each power of two is split into SUB_BUCKETS linear buckets, so the
+// relative error of any reported value is under 1 / SUB_BUCKETS (~3%),
+// from single nanoseconds up to centuries.  Recording is a bit scan and
+// an increment: cheap enough to do for every IO, on the IO thread.
+// Keep one per thread and merge() them when the run is over.
+//
+// Every field has a single writer, the thread calling record(), and is
+// updated with relaxed atomic stores.  On x86 and ARM those are plain
+// moves, but they let another thread merge() a live histogram without
+// a data race.  A live snapshot may be a few IOs behind, never torn.
+class LatencyHistogram
+{
+    private:
+
+    typedef std::atomic<uint64_t> Counter;
+
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    // Values below 2 * SUB_BUCKETS map 1:1.  Above that, each octave
+    // up to 2^63 adds another SUB_BUCKETS buckets.
+    static const int NUM_BUCKETS = ( 65 - SUB_BUCKET_BITS ) * SUB_BUCKETS;
+
+    std::array< Counter, NUM_BUCKETS > counts_;
+
+    Counter totalCount_;
+    Counter minValue_;
+    Counter maxValue_;
+    Counter sum_;
+
+    public:
+
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        for( auto &c: counts_ )
+        {
+            set( c, 0 );
+        }
+
+        set( totalCount_, 0 );
+        set( minValue_, std::numeric_limits<uint64_t>::max() );
+        set( maxValue_, 0 );
+        set( sum_, 0 );
+    }
+
+    void record( uint64_t nanoseconds )
+    {
+        Counter &bucket = counts_[ getBucket( nanoseconds ) ];
+
+        set( bucket, get( bucket ) + 1 );
+        set( totalCount_, get( totalCount_ ) + 1 );
+        set( sum_, get( sum_ ) + nanoseconds );
+
+        if( nanoseconds < get( minValue_ ) ) set( minValue_, nanoseconds );
+        if( nanoseconds > get( maxValue_ ) ) set( maxValue_, nanoseconds );
+    }
+
+    void merge( const LatencyHistogram &other )
+    {
+        for( int i = 0; i < NUM_BUCKETS; ++i )
+        {
+            set( counts_[i], get( counts_[i] ) + get( other.counts_[i] ) );
+        }
+
+        set( totalCount_, get( totalCount_ ) + get( other.totalCount_ ) );
+        set( sum_, get( sum_ ) + get( other.sum_ ) );
+        set( minValue_, std::min( get( minValue_ ), get( other.minValue_ ) ) );
+        set( maxValue_, std::max( get( maxValue_ ), get( other.maxValue_ ) ) );
+    }
+
+    // Turns a cumulative snapshot into the interval since an earlier
+    // snapshot of the same histograms.  Min and max are left alone,
+    // since they can't be un-merged.
+    void subtract( const LatencyHistogram &earlier )
+    {
+        for( int i = 0; i < NUM_BUCKETS; ++i )
+        {
+            set( counts_[i], get( counts_[i] ) - get( earlier.counts_[i] ) );
+        }
+
+        set( totalCount_, get( totalCount_ ) - get( earlier.totalCount_ ) );
+        set( sum_, get( sum_ ) - get( earlier.sum_ ) );
+    }
+
+    uint64_t getCount() const
+    {
+        return get( totalCount_ );
+    }
+
+    uint64_t getMax() const
+    {
+        return get( maxValue_ );
+    }
+
+    uint64_t getMin() const
+    {
+        return ( getCount() > 0 ) ? get( minValue_ ) : 0;
+    }
+
+    double getMean() const
+    {
+        return ( getCount() > 0 ) ?
+            static_cast<double>( get( sum_ ) ) / getCount() : 0;
+    }
+
+    // Smallest recorded value v such that at least pct percent of all
+    // values are <= v, give or take the bucket resolution.
+    uint64_t getPercentile( double pct ) const
+    {
+        uint64_t totalCount = getCount();
+
+        if( totalCount == 0 ) return 0;
+
+        uint64_t rank = static_cast<uint64_t>(
+            std::ceil( pct / 100 * totalCount ) );
+
+        rank = std::max<uint64_t>( rank, 1 );
+
+        uint64_t seen = 0;
+
+        for( int i = 0; i < NUM_BUCKETS; ++i )
+        {
+            seen += get( counts_[i] );
+
+            if( seen >= rank )
+            {
+                return std::min( getBucketUpperBound( i ), getMax() );
+            }
+        }
+
+        return getMax();
+    }
+
+    // Calls visit( upperBound, count ) for each non-empty bucket, in
+    // increasing order of latency
+    template<typename Visitor>
+    void forEachBucket( Visitor visit ) const
+    {
+        for( int i = 0; i < NUM_BUCKETS; ++i )
+        {
+            uint64_t count = get( counts_[i] );
+
+            if( count > 0 ) visit( getBucketUpperBound( i ), count );
+        }
+    }
+
+    // Earth mover's (Wasserstein-1) distance between two distributions,
+    // relative to the mean of the second: roughly, by what fraction of
+    // a typical latency every IO in a would have to move to turn a into
+    // b.  Unlike a KS statistic it isn't tripped by tiny shifts of a
+    // very tight distribution, and it weighs tail movement by how far
+    // the tail moved.
+    static double getRelativeDistance(
+            const LatencyHistogram &a,
+            const LatencyHistogram &b )
+    {
+        double countA = static_cast<double>( a.getCount() );
+        double countB = static_cast<double>( b.getCount() );
+
+        if( ( countA == 0 ) || ( countB == 0 ) ) return 0;
+
+        uint64_t seenA = 0;
+        uint64_t seenB = 0;
+        double distance = 0;
+        double meanB = 0;
+
+        for( int i = 0; i < NUM_BUCKETS - 1; ++i )
+        {
+            seenA += get( a.counts_[i] );
+            seenB += get( b.counts_[i] );
+
+            meanB += get( b.counts_[i] ) / countB * getBucketUpperBound( i );
+
+            // Both CDFs have reached 1, nothing left to move
+            if( ( seenA == a.getCount() ) && ( seenB == b.getCount() ) )
+            {
+                break;
+            }
+
+            double cdfA = seenA / countA;
+            double cdfB = seenB / countB;
+
+            double width = static_cast<double>(
+                getBucketUpperBound( i + 1 ) - getBucketUpperBound( i ) );
+
+            distance += std::abs( cdfA - cdfB ) * width;
+        }
+
+        return ( meanB > 0 ) ? distance / meanB : 0;
+    }
+
+    // e.g. "p50 12.1, p90 15.0, p99 31.2, p99.9 80.4, p99.99 201.7,
+    // max 1022.3", in microseconds
+    std::string getSummary() const
+    {
+        static const double PERCENTILES[] = { 50, 90, 99, 99.9, 99.99 };
+        static const char *LABELS[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+
+        std::ostringstream msg;
+
+        msg << std::setiosflags( std::ios::fixed )
+            << std::setprecision( 1 );
+
+        for( int i = 0; i < 5; ++i )
+        {
+            msg << LABELS[i] << " "
+                << getPercentile( PERCENTILES[i] ) / 1000.0 << ", ";
+        }
+
+        msg << "max " << getMax() / 1000.0;
+
+        return msg.str();
+    }
+
+    private:
+
+    static uint64_t get( const Counter &c )
+    {
+        return c.load( std::memory_order_relaxed );
+    }
+
+    static void set( Counter &c, uint64_t value )
+    {
+        c.store( value, std::memory_order_relaxed );
+    }
+
+    static int floorLog2( uint64_t value )
+    {
+        assert( value != 0 );
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64( &index, value );
+        return static_cast<int>( index );
+#else
+        return 63 - __builtin_clzll( value );
+#endif
+    }
+
+    static int getBucket( uint64_t value )
+    {
+        if( value < 2 * SUB_BUCKETS ) return static_cast<int>( value );
+
+        int shift = floorLog2( value ) - SUB_BUCKET_BITS;
+
+        // ( value >> shift ) is in [SUB_BUCKETS, 2 * SUB_BUCKETS)
+        return shift * SUB_BUCKETS + static_cast<int>( value >> shift );
+    }
+
+    static uint64_t getBucketUpperBound( int bucket )
+    {
+        if( bucket < 2 * SUB_BUCKETS ) return bucket;
+
+        int shift = bucket / SUB_BUCKETS - 1;
+        uint64_t subBucket = bucket % SUB_BUCKETS + SUB_BUCKETS;
+
+        return ( ( subBucket + 1 ) << shift ) - 1;
+    }
+};
+
+#endif // __LATENCY_HISTOGRAM_H_
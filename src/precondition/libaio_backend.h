@@ -0,0 +1,295 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __LIBAIO_BACKEND_H_
+#define __LIBAIO_BACKEND_H_
+
+#ifdef __linux__
+
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+
+#include "precondition.h"
+#include "io_backend.h"
+
+// Linux native AIO, for kernels where io_uring is missing or blocked.
+// Like libaio itself this is only truly asynchronous with O_DIRECT, which
+// checkedOpenTarget always uses.  We use the raw syscalls, so there is no
+// dependency on libaio.so.
+//
+// AIO can't discard, so discards are done synchronously in submit(),
+// and the IOs already in flight on this thread wait that long to be
+// reaped.
+class LibaioBackend : public IOBackend
+{
+    private:
+
+    int targetFd_;
+    bool blockDevice_;
+    aio_context_t context_;
+
+    std::vector< iocb > iocbs_;
+    std::vector< iocb* > pending_;
+    std::vector< io_event > events_;
+
+    int64_t inFlight_;
+
+    // Discards waiting for the next reap()
+    std::vector< IOCompletion > doneInline_;
+
+    public:
+
+    LibaioBackend( int64_t queueDepth )
+        : targetFd_( -1 )
+        , blockDevice_( false )
+        , context_( 0 )
+        , iocbs_( queueDepth )
+        , events_( queueDepth )
+        , inFlight_( 0 )
+    {
+        using namespace std;
+
+        pending_.reserve( queueDepth );
+
+        if( syscall( __NR_io_setup, queueDepth, &context_ ) != 0 )
+        {
+            int error = errno;
+
+            cerr << "io_setup failed. errno = " 
+                << error << " (" << strerror( error ) << ")" << endl;
+
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    ~LibaioBackend()
+    {
+        syscall( __NR_io_destroy, context_ );
+    }
+
+    static bool isSupported()
+    {
+        aio_context_t context = 0;
+
+        if( syscall( __NR_io_setup, 1, &context ) != 0 ) return false;
+
+        syscall( __NR_io_destroy, context );
+
+        return true;
+    }
+
+    std::string getName() const
+    {
+        return "libaio";
+    }
+
+    void openTarget( const std::string& targetName, bool /* rawDisk */ )
+    {
+        targetFd_ = checkedOpenTarget( targetName );
+        blockDevice_ = isBlockDevice( targetFd_ );
+    }
+
+    void closeTarget()
+    {
+        close( targetFd_ );
+        targetFd_ = -1;
+    }
+
+    int64_t getTargetSize()
+    {
+        return checkedGetTargetSize( targetFd_ );
+    }
+
+    TargetGeometry getTargetGeometry()
+    {
+        return queryTargetGeometry( targetFd_ );
+    }
+
+    void submit( const IORequest& request )
+    {
+        if( request.isDiscard )
+        {
+            IOCompletion completion;
+
+            completion.slot = request.slot;
+            completion.error = discardRange( 
+                targetFd_, blockDevice_, request.offset, request.bytes );
+            completion.bytes = ( completion.error == 0 ) ? request.bytes : 0;
+
+            doneInline_.push_back( completion );
+
+            return;
+        }
+
+        iocb &cb = iocbs_[request.slot];
+        memset( &cb, 0, sizeof( cb ) );
+
+        cb.aio_data = request.slot;
+        cb.aio_lio_opcode = 
+            request.isWrite ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+        cb.aio_fildes = targetFd_;
+        cb.aio_buf = reinterpret_cast<uintptr_t>( request.buffer );
+        cb.aio_nbytes = request.bytes;
+        cb.aio_offset = request.offset;
+
+        // Deferred until reap(), so a batch costs one io_submit
+        pending_.push_back( &cb );
+
+        inFlight_++;
+    }
+
+    size_t reap(
+        std::vector<IOCompletion>& completions,
+        int64_t timeoutNanoseconds,
+        size_t minCompletions )
+    {
+        assert( ( inFlight_ > 0 ) || !doneInline_.empty() );
+
+        submitPending();
+
+        size_t numReaped = doneInline_.size();
+
+        completions.insert( 
+            completions.end(), doneInline_.begin(), doneInline_.end() );
+
+        doneInline_.clear();
+
+        long minEvents = ( numReaped < minCompletions ) ?
+            static_cast<long>( std::min<int64_t>( 
+                minCompletions - numReaped, inFlight_ ) ) : 0;
+
+        // Don't wait if we already have enough to hand back
+        if( minEvents == 0 ) timeoutNanoseconds = 0;
+
+        timespec timeout;
+        timeout.tv_sec = timeoutNanoseconds / 1000000000LL;
+        timeout.tv_nsec = timeoutNanoseconds % 1000000000LL;
+
+        int numEvents = getEvents( minEvents,
+            ( timeoutNanoseconds == WAIT_FOREVER ) ? NULL : &timeout );
+
+        for( int i = 0; i < numEvents; ++i )
+        {
+            const io_event &ev = events_[i];
+            
+            int64_t res = static_cast<int64_t>( ev.res );
+
+            IOCompletion completion;
+
+            completion.slot = static_cast<int64_t>( ev.data );
+            completion.bytes = ( res < 0 ) ? 0 : res;
+            completion.error = ( res < 0 ) ? static_cast<int>( -res ) : 0;
+
+            completions.push_back( completion );
+        }
+
+        return numReaped + numEvents;
+    }
+
+    void cancel()
+    {
+        doneInline_.clear();
+
+        // io_cancel is not implemented for block devices, so all we can
+        // do is not submit what hasn't gone out yet, and wait for the rest.
+        inFlight_ -= pending_.size();
+        pending_.clear();
+
+        while( inFlight_ > 0 )
+        {
+            getEvents( 1 );
+        }
+    }
+
+    void flush()
+    {
+        checkedFsync( targetFd_ );
+    }
+
+    private:
+
+    void submitPending()
+    {
+        using namespace std;
+
+        size_t submitted = 0;
+
+        while( submitted < pending_.size() )
+        {
+            long retVal = syscall(
+                __NR_io_submit,
+                context_,
+                pending_.size() - submitted,
+                &pending_[submitted] );
+
+            if( retVal < 0 )
+            {
+                if( errno == EINTR ) continue;
+
+                cerr << "io_submit failed. errno = " << errno << endl;
+
+                exit( EXIT_FAILURE );
+            }
+
+            submitted += retVal;
+        }
+
+        pending_.clear();
+    }
+
+    // Returns 0 if the timeout passes first
+    int getEvents( long minEvents, timespec *timeout = NULL )
+    {
+        using namespace std;
+
+        for( ;; )
+        {
+            long retVal = syscall(
+                __NR_io_getevents,
+                context_,
+                minEvents,
+                events_.size(),
+                &events_[0],
+                timeout );
+
+            if( retVal >= 0 )
+            {
+                inFlight_ -= retVal;
+                return static_cast<int>( retVal );
+            }
+
+            if( errno == EINTR ) continue;
+
+            cerr << "io_getevents failed. errno = " << errno << endl;
+
+            exit( EXIT_FAILURE );
+        }
+    }
+};
+
+#endif // __linux__
+#endif // __LIBAIO_BACKEND_H_
@@ -0,0 +1,2 @@
+#!/bin/sh
+c++ -std=c++11 -O2 -pthread -I. precondition.cpp -o precondition
@@ -28,64 +28,211 @@
 
 #include "precondition.h"
 #include "steady_state_detector.h"
+#include "block_permutation.h"
+#include "latency_histogram.h"
+#include "compressible_data.h"
+#include "unique_payload.h"
+#include "verify_block.h"
+#include "block_size_distribution.h"
+#include "access_generator.h"
+#include "token_bucket.h"
+#include "time_series.h"
+#include "trace_replay.h"
+#include "topology.h"
+#include "buffer_pool.h"
+#include "io_backend.h"
+#include "win32_backend.h"
+#include "io_uring_backend.h"
+#include "libaio_backend.h"
+#include "psync_backend.h"
 
 using namespace std;
 
+// A device or file to precondition
+struct TargetSpec
+{
+    string name;
+    bool rawDisk;
+};
+
 struct Parameters
 {
-    string testFileName;
-    int64_t blockSize;
+    vector<TargetSpec> targets; // Each gets its own IOEngine
+    int64_t blockSize; // The largest IO size, with -B
+    BlockSizeDistribution readSizes;
+    BlockSizeDistribution writeSizes;
     AccessPattern accessPattern;
+    double zipfTheta;
+    vector<double> bandSpace; // Percent of the target, per hot/cold band
+    vector<double> bandTraffic; // Percent of the IOs, per hot/cold band
+    double hotspotSigma; // Percent of the target
+    double hotspotDrift; // Percent of the target per second
+    int64_t strideBytes;
+    bool sharedStream; // One sequential stream across all threads
+    int numStreams; // Sequential streams with -k, else 0 for one per thread
     int64_t outstandingIOs;
     int writePercentage;
+    int discardPercentage;
     int numPasses;
     bool runUntilSteadyState;
     int steadyStateGatherSec;
     int steadyStateDwellSec;
     double steadyStateTolerance;
-    bool rawDisk;
+    SteadyStateMetric steadyStateMetric;
+    SteadyStatePolicyType steadyStatePolicy;
+    double latencyTolerance;
     bool shouldPrompt;
     string progressPrefix;
+    string ioBackend;
+    int numThreads;
+    int compressibility;
+    bool uniquePayloads;
+    bool verify;
+    double targetIOPS; // 0 means as fast as possible
+    double targetMBps;
+    string timeSeriesFile; // Empty means don't log one
+    int timeSeriesIntervalMs;
+    string traceFile; // Empty means run a synthetic workload
+    double replaySpeed; // 0 means as fast as the queue depth allows
+    int numaNode; // A node, NUMA_AUTO, or NUMA_OFF
+    bool lockBuffers; // Else we only try
+    bool realTime;
+    bool polled; // Poll for completions instead of waiting for interrupts
 
     Parameters()
-        : testFileName( "INVALID" )
-        , blockSize( DEFAULT_IO_SIZE )
+        : blockSize( DEFAULT_IO_SIZE )
+        , readSizes( DEFAULT_IO_SIZE )
+        , writeSizes( DEFAULT_IO_SIZE )
         , accessPattern( DEFAULT_ACCESS_PATTERN )
+        , zipfTheta( DEFAULT_ZIPF_THETA )
+        , hotspotSigma( DEFAULT_HOTSPOT_SIGMA )
+        , hotspotDrift( DEFAULT_HOTSPOT_DRIFT )
+        , strideBytes( 0 )
+        , sharedStream( false )
+        , numStreams( 0 )
         , outstandingIOs( DEFAULT_OUTSTANDING_IOS )
         , writePercentage( DEFAULT_WRITE_PERCENTAGE )
+        , discardPercentage( 0 )
         , numPasses( DEFAULT_NUM_PASSES )
         , runUntilSteadyState( false )
         , steadyStateGatherSec( SteadyStateDetector::DEFAULT_GATHER_SECONDS )
         , steadyStateDwellSec( SteadyStateDetector::DEFAULT_DWELL_SECONDS )
         , steadyStateTolerance( SteadyStateDetector::DEFAULT_SLOPE_TOLERANCE )
-        , rawDisk( false )
+        , steadyStateMetric( DEFAULT_STEADY_STATE_METRIC )
+        , steadyStatePolicy( SteadyStateDetector::DEFAULT_POLICY )
+        , latencyTolerance( SteadyStateDetector::DEFAULT_LATENCY_TOLERANCE )
         , shouldPrompt( true )
+        , ioBackend( DEFAULT_IO_BACKEND )
+        , numThreads( DEFAULT_NUM_THREADS )
+        , compressibility( DEFAULT_COMPRESSIBILITY )
+        , uniquePayloads( false )
+        , verify( false )
+        , targetIOPS( 0 )
+        , targetMBps( 0 )
+        , timeSeriesIntervalMs( DEFAULT_TIME_SERIES_INTERVAL_MS )
+        , replaySpeed( DEFAULT_REPLAY_SPEED )
+        , numaNode( NUMA_AUTO )
+        , lockBuffers( false )
+        , realTime( false )
+        , polled( false )
     {};
 }
 params;
 
-void printUsage( int argc, char *argv[] )
+// Sized in main(), once we know the target
+BufferPool bufferPool;
+
+// True unless -B mixes sizes, or gives reads and writes different ones
+bool fixedBlockSize()
+{
+    return params.readSizes.isSingleSize() && 
+        params.writeSizes.isSingleSize() &&
+        ( params.readSizes.getMaxSize() == params.blockSize ) &&
+        ( params.writeSizes.getMaxSize() == params.blockSize );
+}
+
+bool isRateLimited()
+{
+    return ( params.targetIOPS > 0 ) || ( params.targetMBps > 0 );
+}
+
+// What every IO size and offset is a multiple of
+int64_t getIOGrain()
+{
+    if( fixedBlockSize() ) return params.blockSize;
+
+    int64_t grain = params.readSizes.getGrain();
+    int64_t otherGrain = params.writeSizes.getGrain();
+
+    while( otherGrain != 0 )
+    {
+        int64_t t = grain % otherGrain;
+        grain = otherGrain;
+        otherGrain = t;
+    }
+
+    return grain;
+}
+
+// Discards come in write sizes
+double getMeanIOSize()
+{
+    int writeSized = params.writePercentage + params.discardPercentage;
+
+    return ( writeSized * params.writeSizes.getMeanSize() +
+        ( 100 - writeSized ) * params.readSizes.getMeanSize() ) / 100;
+}
+
+void printUsage( int /* argc */, char *argv[] )
 {
     string exeName( argv[0] );
 
     cerr 
         << "Usage: " << exeName 
-        << " <target> [options]" << endl << endl;
+        << " <target> [<target>...] [options]" << endl << endl;
 
+#ifdef _WIN32
     cerr 
         << "For <target>, pass a filename or \\\\.\\PHYSICALDRIVE number"
         << endl << endl;
+#else
+    cerr 
+        << "For <target>, pass a filename or block device (e.g. /dev/sdb)"
+        << endl << endl;
+#endif
+    cerr 
+        << "Several targets run at once, each with its own -o and -T"
+        << endl << endl;
     cerr 
         << "Available options:\n"
         << "  -Y\tDon't prompt before writing target (use with caution)\n"
         << "  -bX\tUse X kilobyte sized blocks (default: " 
             << ( DEFAULT_IO_SIZE / 1024 / 1024 ) << "MB)\n"
+        << "  -BSTR\tMix block sizes, as KB/weight:KB/weight..., e.g. "
+            << "4/60:64/30:1024/10\n"
+        << "\tGive reads and writes their own mix with READS,WRITES\n"
         << "  -r\tUse a random pattern of IOs (default: " 
             << accessPatternToString( DEFAULT_ACCESS_PATTERN ) << ")\n"
+        << "  -ASTR\tAccess pattern: sequential, random, reverse, stride:KB,\n"
+        << "\tzipf[:THETA], hotcold:SPACE%/IO%[:SPACE%/IO%...], or\n"
+        << "\tgaussian[:SIGMA%[:DRIFT%/sec]] (default: "
+            << accessPatternToString( DEFAULT_ACCESS_PATTERN ) << ")\n"
         << "  -oX\tUse X outstanding IOs (default: "
             << DEFAULT_OUTSTANDING_IOS << ")\n"
+        << "  -TX\tSplit IOs and target across X threads (default: "
+            << DEFAULT_NUM_THREADS << ")\n"
+        << "  -si\tShare one sequential stream between all threads\n"
+        << "  -kX\tWrite X sequential streams at once, each over its own\n"
+        << "\tregion of the target (default: one per thread)\n"
         << "  -wX\tGenerate IOs such that X% are writes (default: "
             << DEFAULT_WRITE_PERCENTAGE << "%)\n"
+        << "  -DX\tMake X% of IOs discards (TRIM/UNMAP), out of the reads\n"
+        << "  -cX\tMake write data X% compressible (default: "
+            << DEFAULT_COMPRESSIBILITY << "%)\n"
+        << "  -u\tGive every write unique, never-repeated data\n"
+        << "  -v\tStamp and check every sector, then verify the target\n"
+        << "  -iX\tLimit IOs to X per second, in total (default: no limit)\n"
+        << "  -MX\tLimit IOs to X MB per second, in total (default: no limit)\n"
         << "  -nX\tRun until X number of passes are complete (default: "
             << DEFAULT_NUM_PASSES << ")\n"
         << "  -ss\tRun until steady-state is achieved\n"
@@ -95,12 +242,229 @@ void printUsage( int argc, char *argv[] )
             << SteadyStateDetector::DEFAULT_DWELL_SECONDS << ")\n"
         << "  -tX\tSlope tolerance for steady-state (default: "
             << SteadyStateDetector::DEFAULT_SLOPE_TOLERANCE << ")\n"
+        << "  -aSTR\tSteady-state rule: slope, or pts for SNIA PTS (default: "
+            << steadyStatePolicyToString( 
+                SteadyStateDetector::DEFAULT_POLICY ) << ")\n"
+        << "  -mSTR\tSteady-state metric: ios, bytes, or latency (default: "
+            << steadyStateMetricToString( DEFAULT_STEADY_STATE_METRIC ) << ")\n"
+        << "  -lX\tLatency distribution tolerance for -mlatency (default: "
+            << SteadyStateDetector::DEFAULT_LATENCY_TOLERANCE << ")\n"
+        << "  -LSTR\tLog a time series to file STR, and as CSV to STR.csv\n"
+        << "\t(with several targets, to STR.N and STR.N.csv for target N)\n"
+        << "  -IX\tLog one time series interval per X ms (default: "
+            << DEFAULT_TIME_SERIES_INTERVAL_MS << ")\n"
+        << "  -RSTR\tReplay the IOs in trace file STR, as time,R|W|D,offset,bytes\n"
+        << "  -xX\tReplay at X times the trace's speed, or 0 for as fast as\n"
+        << "\tthe queue depth allows (default: " 
+            << DEFAULT_REPLAY_SPEED << ")\n"
+        << "  -NSTR\tRun workers and keep buffers on NUMA node STR, auto for\n"
+        << "\tthe target's own node, or off (default: auto)\n"
+        << "  -K\tFail unless the IO buffers can be locked in memory\n"
+        << "  -H\tRun workers at real-time priority\n"
+        << "  -P\tPoll for completions instead of waiting for interrupts\n"
         << "  -pSTR\tPrefix progress message with STR (default: none)\n"
+#ifdef _WIN32
+        << "  -eSTR\tIO backend: win32 (default: "
+#else
+        << "  -eSTR\tIO backend: io_uring, libaio, psync, or auto (default: "
+#endif
+            << DEFAULT_IO_BACKEND << ")\n"
         << endl << endl;
 
     exit( EXIT_FAILURE );
 }
 
+void checkBlockSize( int64_t size )
+{
+    if( ( size <= 0 ) || ( size > MAX_IO_SIZE ) )
+    {
+        cerr << "Error: block sizes must be between 1 and " 
+            << MAX_IO_SIZE / 1024 << " KB\n";
+        exit( EXIT_FAILURE ); 
+    }
+}
+
+// Every IO must be a whole number of logical sectors, and had better be
+// a whole number of physical ones
+void checkTargetGeometry( const TargetGeometry &geometry )
+{
+    if( geometry.logicalSectorSize > MAX_SECTOR_SIZE )
+    {
+        cerr << "Error: target has " << geometry.logicalSectorSize 
+            << " B sectors, at most " << MAX_SECTOR_SIZE 
+            << " B are supported\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    // Traces are checked as they are read
+    if( !params.traceFile.empty() ) return;
+
+    if( getIOGrain() % geometry.logicalSectorSize != 0 )
+    {
+        cerr << "Error: block sizes must be multiples of the target's "
+            << geometry.logicalSectorSize << " B logical sector\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( getIOGrain() % geometry.physicalSectorSize != 0 )
+    {
+        cerr << "Warning: block sizes that aren't multiples of the target's "
+            << geometry.physicalSectorSize << " B physical sector will "
+            << "be read-modify-written\n";
+    }
+}
+
+// "4/60:64/30:1024/10" means 60% 4K, 30% 64K, 10% 1M
+BlockSizeDistribution parseBlockSizeSplit( const string &split )
+{
+    vector<int64_t> sizes;
+    vector<double> weights;
+
+    istringstream entries( split );
+    string entry;
+
+    while( getline( entries, entry, ':' ) )
+    {
+        size_t slash = entry.find( '/' );
+
+        try
+        {
+            if( slash == string::npos ) throw invalid_argument( entry );
+
+            sizes.push_back( stoll( entry.substr( 0, slash ) ) * 1024 );
+            weights.push_back( stod( entry.substr( slash + 1 ) ) );
+        }
+        catch( const logic_error& )
+        {
+            cerr << "Error: expected KB/weight in -B, got: " << entry << endl;
+            exit( EXIT_FAILURE ); 
+        }
+
+        checkBlockSize( sizes.back() );
+
+        if( weights.back() < 0 )
+        {
+            cerr << "Error: -B weights must be >= 0\n";
+            exit( EXIT_FAILURE ); 
+        }
+    }
+
+    if( sizes.empty() || 
+            ( accumulate( weights.begin(), weights.end(), 0.0 ) <= 0 ) )
+    {
+        cerr << "Error: -B needs at least one size with weight\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    return BlockSizeDistribution( sizes, weights );
+}
+
+// e.g. "zipf:1.2", "hotcold:10/60:20/30", or "gaussian:5:0.5"
+void parseAccessPattern( const string &spec )
+{
+    vector<string> fields;
+
+    istringstream tokens( spec );
+    string field;
+
+    while( getline( tokens, field, ':' ) )
+    {
+        fields.push_back( field );
+    }
+
+    if( fields.empty() ) fields.push_back( "" );
+
+    const string &name = fields[0];
+    size_t numArgs = fields.size() - 1;
+
+    try
+    {
+        if( ( name == "sequential" ) && ( numArgs == 0 ) )
+        {
+            params.accessPattern = SEQUENTIAL;
+            return;
+        }
+        else if( ( name == "random" ) && ( numArgs == 0 ) )
+        {
+            params.accessPattern = RANDOM;
+            return;
+        }
+        else if( ( name == "reverse" ) && ( numArgs == 0 ) )
+        {
+            params.accessPattern = REVERSE;
+            return;
+        }
+        else if( ( name == "stride" ) && ( numArgs == 1 ) )
+        {
+            params.accessPattern = STRIDE;
+            params.strideBytes = stoll( fields[1] ) * 1024;
+
+            if( params.strideBytes > 0 ) return;
+        }
+        else if( ( name == "zipf" ) && ( numArgs <= 1 ) )
+        {
+            params.accessPattern = ZIPF;
+
+            if( numArgs == 1 ) params.zipfTheta = stod( fields[1] );
+
+            if( params.zipfTheta >= 0 ) return;
+        }
+        else if( ( name == "hotcold" ) && ( numArgs >= 1 ) )
+        {
+            params.accessPattern = HOT_COLD;
+
+            bool valid = true;
+
+            for( size_t i = 1; i < fields.size(); ++i )
+            {
+                size_t slash = fields[i].find( '/' );
+
+                if( slash == string::npos )
+                {
+                    valid = false;
+                    break;
+                }
+
+                double space = stod( fields[i].substr( 0, slash ) );
+                double traffic = stod( fields[i].substr( slash + 1 ) );
+
+                valid = valid && ( space > 0 ) && ( traffic >= 0 );
+
+                params.bandSpace.push_back( space );
+                params.bandTraffic.push_back( traffic );
+            }
+
+            double totalSpace = accumulate( 
+                params.bandSpace.begin(), params.bandSpace.end(), 0.0 );
+            double totalTraffic = accumulate( 
+                params.bandTraffic.begin(), params.bandTraffic.end(), 0.0 );
+
+            // Whatever space is left over is one more band, and takes
+            // whatever traffic is left over
+            if( valid && ( totalSpace <= 100 ) && ( totalTraffic <= 100 ) ) 
+            {
+                return;
+            }
+        }
+        else if( ( name == "gaussian" ) && ( numArgs <= 2 ) )
+        {
+            params.accessPattern = GAUSSIAN;
+
+            if( numArgs >= 1 ) params.hotspotSigma = stod( fields[1] );
+            if( numArgs >= 2 ) params.hotspotDrift = stod( fields[2] );
+
+            if( params.hotspotSigma > 0 ) return;
+        }
+    }
+    catch( const logic_error& )
+    {
+        // Not a number; fall through to the error
+    }
+
+    cerr << "Error: bad access pattern: " << spec << endl;
+    exit( EXIT_FAILURE );
+}
+
 void parseCmdline( int argc, char *argv[] )
 {
     if( argc < 2 )
@@ -111,7 +475,20 @@ void parseCmdline( int argc, char *argv[] )
     bool gatherSeen = false;
     bool dwellSeen = false;
     bool tolerSeen = false;
+    bool metricSeen = false;
+    bool policySeen = false;
+    bool latencyTolerSeen = false;
     bool numPassesSeen = false;
+    bool iopsLimitSeen = false;
+    bool mbpsLimitSeen = false;
+    bool intervalSeen = false;
+    bool replaySpeedSeen = false;
+    bool numStreamsSeen = false;
+    string numaSpec;
+    bool blockSizeSeen = false;
+    string blockSizeSplit;
+    bool randomSeen = false;
+    string accessPatternSpec;
 
     for( auto &arg : args )
     {
@@ -121,6 +498,10 @@ void parseCmdline( int argc, char *argv[] )
             {
                 params.runUntilSteadyState = true;
             }
+            else if( arg.substr( 1 ) == "si" )
+            {
+                params.sharedStream = true;
+            }
             else
             {
                 switch( arg[1] )
@@ -132,19 +513,65 @@ void parseCmdline( int argc, char *argv[] )
                     case 'b':
                         // Block size in KB.  Convert to bytes.
                         params.blockSize = stoll( arg.substr( 2 ) ) * 1024;
+
+                        blockSizeSeen = true;
+                        break;
+
+                    case 'B':
+                        blockSizeSplit = arg.substr( 2 );
                         break;
 
                     case 'r':
                         params.accessPattern = RANDOM;
+                        randomSeen = true;
+                        break;
+
+                    case 'A':
+                        accessPatternSpec = arg.substr( 2 );
                         break;
 
                     case 'o':
                         params.outstandingIOs = stoi( arg.substr( 2 ).c_str() );
                         break;
+
+                    case 'T':
+                        params.numThreads = stoi( arg.substr( 2 ) );
+                        break;
+
+                    case 'k':
+                        params.numStreams = stoi( arg.substr( 2 ) );
+                        numStreamsSeen = true;
+                        break;
                     
                     case 'w':
                         params.writePercentage = stoi( arg.substr( 2 ) );
                         break;
+
+                    case 'D':
+                        params.discardPercentage = stoi( arg.substr( 2 ) );
+                        break;
+
+                    case 'c':
+                        params.compressibility = stoi( arg.substr( 2 ) );
+                        break;
+
+                    case 'u':
+                        params.uniquePayloads = true;
+                        break;
+
+                    case 'v':
+                        params.verify = true;
+                        break;
+
+                    case 'i':
+                        params.targetIOPS = stod( arg.substr( 2 ) );
+                        iopsLimitSeen = true;
+                        break;
+
+                    case 'M':
+                        params.targetMBps = stod( arg.substr( 2 ) );
+                        mbpsLimitSeen = true;
+                        break;
                    
                     case 'g':
                         params.steadyStateGatherSec = 
@@ -167,9 +594,94 @@ void parseCmdline( int argc, char *argv[] )
                         tolerSeen = true;
                         break;
 
+                    case 'm':
+                        if( arg.substr( 2 ) == "ios" )
+                        {
+                            params.steadyStateMetric = IOS_METRIC;
+                        }
+                        else if( arg.substr( 2 ) == "bytes" )
+                        {
+                            params.steadyStateMetric = BYTES_METRIC;
+                        }
+                        else if( arg.substr( 2 ) == "latency" )
+                        {
+                            params.steadyStateMetric = LATENCY_METRIC;
+                        }
+                        else
+                        {
+                            cerr << "Unknown metric: " << arg << endl;
+                            printUsage( argc, argv );
+                        }
+
+                        metricSeen = true;
+                        break;
+
+                    case 'a':
+                        if( arg.substr( 2 ) == "slope" )
+                        {
+                            params.steadyStatePolicy = SLOPE_POLICY;
+                        }
+                        else if( arg.substr( 2 ) == "pts" )
+                        {
+                            params.steadyStatePolicy = PTS_POLICY;
+                        }
+                        else
+                        {
+                            cerr << "Unknown steady-state rule: " << arg << endl;
+                            printUsage( argc, argv );
+                        }
+
+                        policySeen = true;
+                        break;
+
+                    case 'l':
+                        params.latencyTolerance
+                            = stod( arg.substr( 2 ) );
+
+                        latencyTolerSeen = true;
+                        break;
+
+                    case 'L':
+                        params.timeSeriesFile = arg.substr( 2 );
+                        break;
+
+                    case 'I':
+                        params.timeSeriesIntervalMs = stoi( arg.substr( 2 ) );
+                        intervalSeen = true;
+                        break;
+
+                    case 'R':
+                        params.traceFile = arg.substr( 2 );
+                        break;
+
+                    case 'x':
+                        params.replaySpeed = stod( arg.substr( 2 ) );
+                        replaySpeedSeen = true;
+                        break;
+
                     case 'p':
                         params.progressPrefix = arg.substr( 2 );
                         break;
+
+                    case 'e':
+                        params.ioBackend = arg.substr( 2 );
+                        break;
+
+                    case 'N':
+                        numaSpec = arg.substr( 2 );
+                        break;
+
+                    case 'K':
+                        params.lockBuffers = true;
+                        break;
+
+                    case 'H':
+                        params.realTime = true;
+                        break;
+
+                    case 'P':
+                        params.polled = true;
+                        break;
                     
                     case 'n':
                         params.numPasses
@@ -186,49 +698,101 @@ void parseCmdline( int argc, char *argv[] )
         }
         else
         {
-            if( regex_match( arg, regex( "^\\d+$" ) ) )
-            {
-                params.testFileName = 
-                    string( "\\\\.\\PHYSICALDRIVE" ) + arg;
+            TargetSpec target;
 
-                params.rawDisk = true;
-            }
-            else if( regex_match( arg, regex( "^[[:alpha:]]:.*" ) ) )
+            target.name = arg;
+            target.rawDisk = false;
+#ifdef _WIN32
+            if( regex_match( arg, regex( "^\\d+$" ) ) )
             {
-                params.testFileName = arg;
+                target.name = string( "\\\\.\\PHYSICALDRIVE" ) + arg;
+                target.rawDisk = true;
             }
-            else
+            else if( !regex_match( arg, regex( "^[[:alpha:]]:.*" ) ) )
             {
                 cerr << "Unexpected target: " << arg << endl;
                 printUsage( argc, argv );
             }
+#endif
+            // Block devices and regular files are opened the same way
+            params.targets.push_back( target );
         }
     }
 
-    if( ( params.accessPattern == RANDOM ) && 
-            !params.runUntilSteadyState )
+    if( params.targets.empty() )
     {
-        // TO DO: Properly support this case.
-        //
-        // This is tricker than it may seem.
-        // 
-        // We'd need to randomly write each block once and only once,
-        // leaving no gaps and never writing the same block twice.  "Oh,
-        // we'll just Fisher-Yates shuffle a vector of offsets.", you say.
-        // Congratulations, you've just designed an algorithm that requires
-        // ~4 GB of DRAM.
-        //
-        // LauraCa's solution is promising.  For a target with X blocks, we
-        // randomly pick X of them, avoiding duplicates via a bitset.  Then
-        // we walk the bitset pushing the offsets of the "holes" onto a
-        // vector.  We then shuffle the vector and fill the holes.  This will
-        // require less DRAM.  Seems like a good uniform RNG will leave us
-        // with 36.8% "gaps" to fill. 
-        //
-        // --MarkSan
-        cerr << "Warning: full target write not guaranteed with -r\n";
+        cerr << "No target given" << endl;
+        printUsage( argc, argv );
     }
-    
+
+    if( !blockSizeSplit.empty() )
+    {
+        if( blockSizeSeen )
+        {
+            cerr << "Error: -b conflicts with -B\n";
+            exit( EXIT_FAILURE ); 
+        }
+
+        size_t comma = blockSizeSplit.find( ',' );
+
+        params.readSizes = 
+            parseBlockSizeSplit( blockSizeSplit.substr( 0, comma ) );
+
+        params.writeSizes = ( comma == string::npos ) ? params.readSizes :
+            parseBlockSizeSplit( blockSizeSplit.substr( comma + 1 ) );
+
+        // Shards and passes are laid out in units of the largest IO
+        params.blockSize = max( 
+            params.readSizes.getMaxSize(), params.writeSizes.getMaxSize() );
+
+        // Counting IOs means nothing when they aren't all the same size
+        if( !metricSeen )
+        {
+            params.steadyStateMetric = BYTES_METRIC;
+        }
+    }
+    else
+    {
+        checkBlockSize( params.blockSize );
+
+        params.readSizes = BlockSizeDistribution( params.blockSize );
+        params.writeSizes = BlockSizeDistribution( params.blockSize );
+    }
+
+    if( !accessPatternSpec.empty() )
+    {
+        if( randomSeen )
+        {
+            cerr << "Error: -r conflicts with -A\n";
+            exit( EXIT_FAILURE ); 
+        }
+
+        parseAccessPattern( accessPatternSpec );
+    }
+
+    if( ( params.accessPattern == STRIDE ) && 
+            ( params.strideBytes % params.blockSize != 0 ) )
+    {
+        cerr << "Error: stride must be a multiple of the block size\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( params.sharedStream )
+    {
+        if( params.accessPattern != SEQUENTIAL )
+        {
+            cerr << "Error: -si requires a sequential pattern\n";
+            exit( EXIT_FAILURE ); 
+        }
+
+        // Workers check only their own slice
+        if( params.verify )
+        {
+            cerr << "Error: -si conflicts with -v\n";
+            exit( EXIT_FAILURE ); 
+        }
+    }
+
     if( !(params.outstandingIOs >= 1) ) 
     {
         cerr << "Error: -oX must be >= 1\n";
@@ -240,6 +804,49 @@ void parseCmdline( int argc, char *argv[] )
         exit( EXIT_FAILURE ); 
     }
     
+    if( params.numThreads < 1 ) 
+    {
+        cerr << "Error: -TX must be >= 1\n";
+        exit( EXIT_FAILURE ); 
+    }
+    else if( params.numThreads > params.outstandingIOs )
+    {
+        cerr << "Error: -TX must be <= -oX\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( numStreamsSeen )
+    {
+        if( params.numStreams < 1 ) 
+        {
+            cerr << "Error: -kX must be >= 1\n";
+            exit( EXIT_FAILURE ); 
+        }
+        else if( params.numStreams > params.outstandingIOs )
+        {
+            // Each stream needs an IO in flight to be a stream at all
+            cerr << "Error: -kX must be <= -oX\n";
+            exit( EXIT_FAILURE ); 
+        }
+        else if( params.numThreads > params.numStreams )
+        {
+            cerr << "Error: -TX must be <= -kX\n";
+            exit( EXIT_FAILURE ); 
+        }
+
+        if( params.accessPattern != SEQUENTIAL )
+        {
+            cerr << "Error: -k requires a sequential pattern\n";
+            exit( EXIT_FAILURE ); 
+        }
+
+        if( params.sharedStream )
+        {
+            cerr << "Error: -k conflicts with -si\n";
+            exit( EXIT_FAILURE ); 
+        }
+    }
+
     if( params.writePercentage < 0 ) 
     {
         cerr << "Error: -wX must be >= 0\n";
@@ -250,43 +857,173 @@ void parseCmdline( int argc, char *argv[] )
         cerr << "Error: -oX must be <= 100\n";
         exit( EXIT_FAILURE ); 
     }
-    
-    if( ( params.writePercentage < 100 ) && 
-            !params.runUntilSteadyState )
-    {
-        cerr << "Warning: full target write not guaranteed with -wX < 100\n";
-    }
 
-    if( params.steadyStateGatherSec <= 0 ) 
+    if( ( params.discardPercentage < 0 ) || 
+            ( params.discardPercentage >= 100 ) ) 
     {
-        cerr << "Error: -g must be > 0\n";
+        cerr << "Error: -DX must be >= 0 and < 100\n";
         exit( EXIT_FAILURE ); 
     }
-    
-    if( params.steadyStateDwellSec <= 0 ) 
+    else if( params.writePercentage + params.discardPercentage > 100 )
     {
-        cerr << "Error: -d must be > 0\n";
+        cerr << "Error: -wX plus -DX must be <= 100\n";
         exit( EXIT_FAILURE ); 
     }
-    
-    if( ( gatherSeen || dwellSeen || tolerSeen ) && 
-            !params.runUntilSteadyState)
+
+    if( params.verify && ( params.discardPercentage > 0 ) )
     {
-        cerr << "Error: -g, -d, and -t require -ss\n";
+        cerr << "Error: -D conflicts with -v\n";
         exit( EXIT_FAILURE ); 
     }
     
-    if( params.runUntilSteadyState && numPassesSeen )
+    if( ( params.compressibility < 0 ) || ( params.compressibility > 100 ) )
     {
-        cerr << "Error: -n conflicts with -ss\n";
+        cerr << "Error: -cX must be between 0 and 100\n";
         exit( EXIT_FAILURE ); 
     }
 
-    if( params.numPasses < 1 ) 
+    if( ( params.uniquePayloads || params.verify ) && 
+            ( params.compressibility > 0 ) )
     {
-        cerr << "Error: -n must be >= 1\n";
+        cerr << "Error: -u and -v conflict with -c\n";
         exit( EXIT_FAILURE ); 
     }
+    
+    if( ( iopsLimitSeen && !( params.targetIOPS > 0 ) ) ||
+            ( mbpsLimitSeen && !( params.targetMBps > 0 ) ) )
+    {
+        cerr << "Error: -iX and -MX must be > 0\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( isRateLimited() && params.runUntilSteadyState )
+    {
+        cerr << "Warning: with -i or -M, -ss finds the limit, not the device\n";
+    }
+
+    if( ( params.writePercentage < 100 ) && 
+            !params.runUntilSteadyState )
+    {
+        cerr << "Warning: full target write not guaranteed with -wX < 100\n";
+    }
+
+    if( !fixedBlockSize() && ( params.accessPattern == RANDOM ) &&
+            !params.runUntilSteadyState )
+    {
+        cerr << "Warning: full target write not guaranteed with -B and -r\n";
+    }
+
+    if( ( ( params.accessPattern == ZIPF ) || 
+            ( params.accessPattern == HOT_COLD ) ||
+            ( params.accessPattern == GAUSSIAN ) ) && 
+            !params.runUntilSteadyState )
+    {
+        cerr << "Warning: full target write not guaranteed with -A"
+            << accessPatternToString( params.accessPattern ) << endl;
+    }
+
+    if( params.steadyStateGatherSec <= 0 ) 
+    {
+        cerr << "Error: -g must be > 0\n";
+        exit( EXIT_FAILURE ); 
+    }
+    
+    if( params.steadyStateDwellSec <= 0 ) 
+    {
+        cerr << "Error: -d must be > 0\n";
+        exit( EXIT_FAILURE ); 
+    }
+    
+    if( params.latencyTolerance <= 0 ) 
+    {
+        cerr << "Error: -l must be > 0\n";
+        exit( EXIT_FAILURE ); 
+    }
+    
+    if( ( gatherSeen || dwellSeen || tolerSeen || metricSeen || 
+            policySeen ) && !params.runUntilSteadyState)
+    {
+        cerr << "Error: -g, -d, -t, -m, and -a require -ss\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( tolerSeen && ( params.steadyStatePolicy != SLOPE_POLICY ) )
+    {
+        cerr << "Error: -t requires -aslope\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( latencyTolerSeen && 
+            ( params.steadyStateMetric != LATENCY_METRIC ) )
+    {
+        cerr << "Error: -l requires -mlatency\n";
+        exit( EXIT_FAILURE ); 
+    }
+    
+    if( intervalSeen && params.timeSeriesFile.empty() )
+    {
+        cerr << "Error: -I requires -L\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( params.timeSeriesIntervalMs < 10 )
+    {
+        // We can't sample any faster than the progress monitor
+        cerr << "Error: -I must be >= 10\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( params.runUntilSteadyState && numPassesSeen )
+    {
+        cerr << "Error: -n conflicts with -ss\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( params.numPasses < 1 ) 
+    {
+        cerr << "Error: -n must be >= 1\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( !params.traceFile.empty() )
+    {
+        if( params.runUntilSteadyState || numPassesSeen || params.verify ||
+                params.sharedStream || numStreamsSeen )
+        {
+            cerr << "Error: -R conflicts with -ss, -n, -v, -si, and -k\n";
+            exit( EXIT_FAILURE ); 
+        }
+    }
+    else if( replaySpeedSeen )
+    {
+        cerr << "Error: -x requires -R\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( params.replaySpeed < 0 ) 
+    {
+        cerr << "Error: -xX must be >= 0\n";
+        exit( EXIT_FAILURE ); 
+    }
+
+    if( numaSpec == "auto" )
+    {
+        params.numaNode = NUMA_AUTO;
+    }
+    else if( numaSpec == "off" )
+    {
+        params.numaNode = NUMA_OFF;
+    }
+    else if( !numaSpec.empty() )
+    {
+        if( !regex_match( numaSpec, regex( "^\\d+$" ) ) )
+        {
+            cerr << "Error: -N takes a node number, auto, or off\n";
+            exit( EXIT_FAILURE ); 
+        }
+
+        params.numaNode = stoi( numaSpec );
+    }
 }
 
 void continuePrompt()
@@ -294,13 +1031,18 @@ void continuePrompt()
     cerr << endl 
         << "\tWARNING! WARNING! WARNING!"
         << endl 
-        << "\tThis will overwrite "
-        << params.testFileName
-        << endl << endl;
+        << "\tThis will overwrite ";
+
+    for( size_t i = 0; i < params.targets.size(); ++i )
+    {
+        cerr << ( i > 0 ? ", " : "" ) << params.targets[i].name;
+    }
+
+    cerr << endl << endl;
 
     cerr << "Are you sure you want to continue? [Y/N]" << endl;
 
-    if( toupper( _getch() ) == 'Y' )
+    if( toupper( getKeypress() ) == 'Y' )
     {
         cerr << endl;
         return;
@@ -367,11 +1109,13 @@ class ThroughputMeter
         , lastResetTicks_( std::numeric_limits<int64_t>::min() )
         , currentIOs_( 0 )
         , currentBytes_( 0 )
+        , previousIOs_( 0 )
+        , previousBytes_( 0 )
     {}
 
     public:
 
-    void trackCompletion( int64_t bytes )
+    void trackCompletions( int64_t ios, int64_t bytes )
     {
         int64_t now = qpc();
 
@@ -389,7 +1133,7 @@ class ThroughputMeter
             lastResetTicks_ = now;
         }
             
-        currentIOs_++;
+        currentIOs_ += ios;
         currentBytes_ += bytes;
     }
     
@@ -407,298 +1151,2570 @@ class ThroughputMeter
     }
 };
 
+// sharedCursor is null unless the workers share one stream (-si).
+// streamBounds is empty unless the slice holds several streams (-k).
+unique_ptr<AccessGenerator> createAccessGenerator(
+        int64_t sliceStart,
+        int64_t sliceBytes,
+        uint64_t seed,
+        SharedCursor *sharedCursor,
+        const vector<int64_t> &streamBounds )
+{
+    AccessGenerator *generator = NULL;
+
+    int64_t grain = getIOGrain();
+
+    switch( params.accessPattern )
+    {
+        case SEQUENTIAL:
+            if( sharedCursor )
+            {
+                generator = new SharedSequentialAccess( 
+                    *sharedCursor, sliceBytes );
+            }
+            else if( !streamBounds.empty() )
+            {
+                generator = new MultiStreamAccess( streamBounds );
+            }
+            else
+            {
+                generator = new SequentialAccess( sliceStart, sliceBytes );
+            }
+            break;
+
+        case REVERSE:
+            generator = new ReverseAccess( sliceStart, sliceBytes );
+            break;
+
+        case STRIDE:
+            generator = new StrideAccess( 
+                sliceStart, sliceBytes, params.strideBytes, params.blockSize );
+            break;
+
+        case RANDOM:
+            // Without -ss a pass must cover the whole target, which a
+            // permutation can promise when every IO is the same size
+            if( !params.runUntilSteadyState && fixedBlockSize() )
+            {
+                generator = new PermutedAccess( 
+                    sliceStart, sliceBytes, params.blockSize, seed );
+            }
+            else
+            {
+                generator = new UniformAccess( 
+                    sliceStart, sliceBytes, grain, seed );
+            }
+            break;
+
+        case ZIPF:
+            generator = new ZipfAccess( 
+                sliceStart, sliceBytes, grain, seed, params.zipfTheta );
+            break;
+
+        case HOT_COLD:
+            generator = new HotColdAccess( 
+                sliceStart, sliceBytes, grain, seed,
+                params.bandSpace, params.bandTraffic );
+            break;
+
+        case GAUSSIAN:
+            generator = new GaussianAccess( 
+                sliceStart, sliceBytes, grain, seed,
+                params.hotspotSigma / 100, params.hotspotDrift / 100 );
+            break;
+    }
+
+    return unique_ptr<AccessGenerator>( generator );
+}
+
+// One per worker thread, padded so the workers don't false-share.
+// Each field has exactly one writer, its IOGenerator, so plain
+// relaxed stores are enough: no locked read-modify-write needed.
+struct alignas( 64 ) WorkerStats
+{
+    atomic<int64_t> completedIOs;
+    atomic<int64_t> completedBytes;
+    atomic<int64_t> readBytes; // Split out for the time series
+    atomic<int64_t> writeBytes;
+    atomic<int64_t> discardBytes; // Not in completedBytes, moves no data
+    atomic<int64_t> traceBytes; // How much of our piece of the trace we've read
+    atomic<bool> finished;
+
+    WorkerStats()
+        : completedIOs( 0 )
+        , completedBytes( 0 )
+        , readBytes( 0 )
+        , writeBytes( 0 )
+        , discardBytes( 0 )
+        , traceBytes( 0 )
+        , finished( false )
+    {}
+};
+
+// For -k.  How one of a worker's streams is getting on.
+struct StreamStats
+{
+    int64_t completedBytes;
+    int64_t firstSubmitTime;
+    int64_t lastCompletionTime;
+
+    StreamStats()
+        : completedBytes( 0 )
+        , firstSubmitTime( 0 )
+        , lastCompletionTime( 0 )
+    {}
+
+    double getMBps() const
+    {
+        double seconds = static_cast<double>( 
+            lastCompletionTime - firstSubmitTime ) / QPC_TICKS_PER_SEC;
+
+        return ( seconds > 0 ) ? completedBytes / 1024.0 / 1024.0 / seconds : 0;
+    }
+};
+
 class IOGenerator
 {
     private:
 
-    HANDLE targetHandle_;
+    unique_ptr<IOBackend> backend_;
+    const TargetSpec TARGET;
     int64_t targetSize_;
+    const TargetGeometry GEOMETRY;
     int numPasses_;
 
     int64_t completedBytes_;
+    int64_t completedWriteBytes_;
+    int64_t postedBytes_;
     int64_t postedIOs_;
     int64_t completedIOs_;
     int64_t inFlight_;
-    
-    bool steadyStateAchieved_;
-    bool steadyStateAssumedIOs_;
-    
-    array< OVERLAPPED, MAX_OUTSTANDING_IOS > overlapped_;
 
-    const int64_t TOTAL_BLOCKS;
-    
-    const int64_t MAX_STEADY_STATE_IOS;
-   
-    int64_t qpcStart_;
-    
-    SteadyStateDetector steadyStateDetector_;
-    ThroughputMeter throughputMeter_;
-    StatusLine statusLine_;
+    // For -D.  Discards count towards the IOs above, since they use up
+    // the access pattern like any other IO, but their bytes are kept
+    // apart: trimming a range moves no data, so it isn't bandwidth.
+    int64_t completedDiscards_;
+    int64_t completedDiscardBytes_;
+
+    vector< IOCompletion > completions_;
+
+    struct SlotState
+    {
+        int64_t submitTime;
+        bool isWrite;
+        bool isDiscard;
+        int64_t offset;
+        int64_t bytes;
+        bool mustBeCurrent; // -v: we'd written these grains at submit time
+        int64_t stream; // -k: which of our streams it belongs to
+    };
+
+    vector< SlotState > slots_;
+
+    // Per thread, so recording never contends.  Merged by IOEngine.
+    LatencyHistogram readLatency_;
+    LatencyHistogram writeLatency_;
+    LatencyHistogram discardLatency_;
+
+    // Our slice of the target, in blocks of the largest IO size
+    const int64_t FIRST_BLOCK;
+    const int64_t NUM_BLOCKS;
+
+    // ...and in bytes, since with -B IOs come in many sizes
+    const int64_t SLICE_START;
+    const int64_t SLICE_END;
+    const int64_t SLICE_BYTES;
+
+    // Our slots are [SLOT_BASE, SLOT_BASE + QUEUE_DEPTH) in bufferPool
+    const int64_t SLOT_BASE;
+    const int64_t QUEUE_DEPTH;
+
+    WorkerStats &stats_;
+    const atomic<bool> &stopRequested_;
+
+    mt19937 rngEngine_;
+
+    // For -si.  Our slice is then the whole target, and we stop when
+    // the stream we share with the other workers runs out.
+    const bool SHARED_STREAM;
+
+    // For -k.  Our slice is split into regions at these offsets, one
+    // sequential stream each.  Both empty without -k.
+    const vector<int64_t> STREAM_BOUNDS;
+    vector<StreamStats> streamStats_;
+
+    unique_ptr<AccessGenerator> accessGenerator_;
+
+    // For -u.  Time spent generating is wall clock on this thread,
+    // which is CPU time as long as the generator doesn't block.
+    const uint64_t PAYLOAD_NONCE;
+    int64_t payloadTicks_;
+    int64_t payloadBytes_;
+
+    // For -v.  Which parts of our slice have been written this run, so
+    // reads of them can insist on finding our seed.  Tracked in grains
+    // that every IO size is a multiple of.
+    const int64_t VERIFY_GRAIN;
+    vector<bool> writtenGrains_;
+    int64_t verifiedSectors_;
+    int64_t verifyMismatches_;
+    vector<VerifyMismatch> mismatchReports_;
+
+    // Don't bury the first few under thousands more
+    static const size_t MAX_REPORTED_MISMATCHES = 16;
+
+    // For -i and -M: our share of the limit.  Slots whose IO has
+    // completed wait here until the buckets let us reuse them.
+    const double RATE_SHARE;
+    TokenBucket iopsBucket_;
+    TokenBucket bandwidthBucket_;
+    vector< int64_t > idleSlots_;
+
+    // When we started and stopped issuing IOs, to report the rate
+    int64_t ioStartTime_;
+    int64_t ioEndTime_;
+
+    bool buffersRegistered_;
+
+    // For -R.  Null unless we are replaying our piece of a trace.  With
+    // -x above 0, each record is due at its time in the trace, scaled,
+    // after the epoch all workers share; how late we issue it is lag.
+    unique_ptr<TraceReader> trace_;
+    TraceRecord nextRecord_;
+    bool haveRecord_;
+    double lastRecordSeconds_;
+    int64_t replayEpoch_;
+    LatencyHistogram replayLag_;
+
+    // Slots wait in idleSlots_ for the buckets or the trace's clock
+    const bool PACED;
+
+    // For -P.  IOs run in phases of POLL_PHASE_IOS.  One phase in
+    // INTERRUPT_PHASE_PERIOD waits for interrupts as usual, so we can
+    // say what polling saved.  Every IO goes in the usual histograms,
+    // and in interruptLatency_ or polledLatency_ as well.  With kernel
+    // polling each phase drains before the next starts, as a ring can
+    // only be switched between polled and not with nothing in flight.
+    // Spinning on reap() ourselves, we just change how we reap.
+    const bool POLLED;
+    bool kernelPolled_; // Else we spin on reap() ourselves
+    bool interruptPhase_;
+    bool switchingPhase_; // Draining; slots wait in idleSlots_
+    int64_t phaseIOs_;
+    int64_t phaseCount_;
+    LatencyHistogram interruptLatency_;
+    LatencyHistogram polledLatency_;
+
+    // More than any worker's queue depth, so a phase can fill it
+    static const int64_t POLL_PHASE_IOS = 1024;
+    static const int64_t INTERRUPT_PHASE_PERIOD = 8;
+
+    // Without kernel polling, how long we spin on reap() before we
+    // sleep in it.  Past this, the IO is slow enough that a wakeup is
+    // a small part of it.
+    static const int64_t MAX_SPIN_NANOSECONDS = 100000;
+
+    // How many completions each reap() waits for.  One wakeup then
+    // handles a batch, and the slots it frees go back to the backend
+    // in one submit.  Once per REAP_BATCH_WINDOW_MS we double or halve
+    // the batch, carrying on the same way while IOPS improve and
+    // turning back when they don't.  At most 1 / REAP_BATCH_DIVISOR
+    // of our slots sit done but unreaped, so the device still sees
+    // close to the requested queue depth.  Paced and -P runs take each
+    // completion as it comes, as they are timing every IO.
+    const int64_t MAX_REAP_BATCH;
+    int64_t reapBatch_;
+    bool reapBatchGrowing_;
+    int64_t batchWindowStart_;
+    int64_t batchWindowIOs_; // completedIOs_ when the window began
+    double batchWindowIOPS_; // What the last window achieved
+    int64_t reapCalls_; // A spin on reap() counts once, when it reaps
+
+    static const int64_t REAP_BATCH_WINDOW_MS = 100;
+    static const int64_t REAP_BATCH_DIVISOR = 4;
 
     public:
 
-    IOGenerator( 
-            HANDLE targetHandle,
+    IOGenerator(
+            unique_ptr<IOBackend> backend,
+            const TargetSpec &target,
             int64_t targetSize,
-            int numPasses )
-        : targetHandle_( targetHandle )
+            const TargetGeometry &geometry,
+            int numPasses,
+            int64_t firstBlock,
+            int64_t numBlocks,
+            int64_t slotBase,
+            int64_t queueDepth,
+            WorkerStats &stats,
+            const atomic<bool> &stopRequested,
+            uint64_t payloadNonce,
+            double rateShare,
+            unique_ptr<TraceReader> trace,
+            SharedCursor *sharedCursor,
+            const vector<int64_t> &streamBounds )
+        : backend_( move( backend ) )
+        , TARGET( target )
         , targetSize_( targetSize )
+        , GEOMETRY( geometry )
         , numPasses_( numPasses )
         , completedBytes_( 0 )
+        , completedWriteBytes_( 0 )
+        , postedBytes_( 0 )
         , postedIOs_( 0 )
         , completedIOs_( 0 )
         , inFlight_( 0 )
-        , steadyStateAchieved_( false )
-        , steadyStateAssumedIOs_( false )
-        , TOTAL_BLOCKS( divRoundUp( targetSize, params.blockSize ) )
-        , MAX_STEADY_STATE_IOS( 2 * TOTAL_BLOCKS ) // ~2 overwrites
-        , qpcStart_( qpc() )
-        , steadyStateDetector_(
-                params.steadyStateGatherSec,
-                params.steadyStateDwellSec,
-                params.steadyStateTolerance )
+        , completedDiscards_( 0 )
+        , completedDiscardBytes_( 0 )
+        , slots_( queueDepth )
+        , FIRST_BLOCK( firstBlock )
+        , NUM_BLOCKS( numBlocks )
+        , SLICE_START( firstBlock * params.blockSize )
+        , SLICE_END( 
+            min( ( firstBlock + numBlocks ) * params.blockSize, targetSize ) )
+        , SLICE_BYTES( SLICE_END - SLICE_START )
+        , SLOT_BASE( slotBase )
+        , QUEUE_DEPTH( queueDepth )
+        , stats_( stats )
+        , stopRequested_( stopRequested )
+        , rngEngine_( static_cast<uint32_t>( qpc() + slotBase ) )
+        , SHARED_STREAM( sharedCursor != NULL )
+        , STREAM_BOUNDS( streamBounds )
+        , streamStats_( 
+            streamBounds.empty() ? 0 : streamBounds.size() - 1 )
+        , accessGenerator_( createAccessGenerator( 
+            SLICE_START, 
+            SLICE_BYTES, 
+            rngEngine_(), 
+            sharedCursor, 
+            STREAM_BOUNDS ) )
+        , PAYLOAD_NONCE( payloadNonce )
+        , payloadTicks_( 0 )
+        , payloadBytes_( 0 )
+        , VERIFY_GRAIN( getIOGrain() )
+        , writtenGrains_( 
+            params.verify ? divRoundUp( SLICE_BYTES, VERIFY_GRAIN ) : 0, 
+            false )
+        , verifiedSectors_( 0 )
+        , verifyMismatches_( 0 )
+        , RATE_SHARE( rateShare )
+        , ioStartTime_( 0 )
+        , ioEndTime_( 0 )
+        , buffersRegistered_( false )
+        , trace_( move( trace ) )
+        , haveRecord_( false )
+        , lastRecordSeconds_( 0 )
+        , replayEpoch_( 0 )
+        , PACED( isRateLimited() || ( trace_ && ( params.replaySpeed > 0 ) ) )
+        , POLLED( params.polled )
+        , kernelPolled_( false )
+        , interruptPhase_( false )
+        , switchingPhase_( false )
+        , phaseIOs_( 0 )
+        , phaseCount_( 0 )
+        , MAX_REAP_BATCH( ( PACED || POLLED ) ? 1 : 
+            max<int64_t>( 1, QUEUE_DEPTH / REAP_BATCH_DIVISOR ) )
+        , reapBatch_( 1 )
+        , reapBatchGrowing_( true )
+        , batchWindowStart_( 0 )
+        , batchWindowIOs_( 0 )
+        , batchWindowIOPS_( 0 )
+        , reapCalls_( 0 )
     {
-        // We will reuse this write buffer over and over with a 
-        // random offset. Should be enough entropy to defeat compression.
-        //
-        // N.B: Earlier attempts generated new random data 
-        // for each IO, and ended up CPU-limited.
-        randomFillBuffer( writeDataBuffer );
+        completions_.reserve( QUEUE_DEPTH );
+        idleSlots_.reserve( QUEUE_DEPTH );
 
-#ifndef NDEBUG
-        for( auto &i: readDataBuffers )
+        if( trace_ )
         {
-            i.fill( 0xFF );
-        }
-#endif
-        for( auto &i: overlapped_ )
-        {
-            // Completion routines allow us to abuse the hEvent field
-            // See ioCompletionRoutine for the matching cast back.
-            i.hEvent = reinterpret_cast<HANDLE>( this );
+            haveRecord_ = trace_->next( nextRecord_ );
         }
     }
 
-    void run()
+    string getBackendName() const
     {
-        // Kick off initial IOs
-        const int64_t initialIOs = min( TOTAL_BLOCKS, params.outstandingIOs ); 
+        return backend_->getName();
+    }
 
-        for( int64_t i = 0; i < initialIOs; ++i )
-        {
-            postNextIO( i );
-        }
+    // Only meaningful once run() has returned
+    const LatencyHistogram &getReadLatency() const
+    {
+        return readLatency_;
+    }
 
-        do 
-        {
-            // Alertable wait allows async IOs to complete
-            SleepEx( INFINITE, true );
-        }
-        while( !allIOsCompleted() );
+    const LatencyHistogram &getWriteLatency() const
+    {
+        return writeLatency_;
+    }
 
-        // We are now finshed writing
-        
-        checkedFlushFileBuffers( targetHandle_ );
-       
-        doFinalSanityChecks();
+    const LatencyHistogram &getDiscardLatency() const
+    {
+        return discardLatency_;
+    }
 
-        cerr << endl;
+    int64_t getCompletedDiscards() const
+    {
+        return completedDiscards_;
+    }
 
-        if( params.runUntilSteadyState )
-        {
-            cout << getSteadyStateReasonString() << endl;
-        }     
+    int64_t getCompletedDiscardBytes() const
+    {
+        return completedDiscardBytes_;
     }
 
-    private:
-    
-    void doFinalSanityChecks() const
+    int64_t getPayloadTicks() const
     {
-        assert( inFlight_ == 0 );
-        assert( shouldPostAnotherIO() == false );
+        return payloadTicks_;
+    }
 
-        if( !params.runUntilSteadyState &&
-                ( params.accessPattern == SEQUENTIAL ) )
-        {
-            assert( completedIOs_ == TOTAL_BLOCKS * numPasses_ );
-            assert( completedBytes_ == targetSize_ * numPasses_ );
-        }
+    int64_t getPayloadBytes() const
+    {
+        return payloadBytes_;
     }
 
-    bool shouldPostAnotherIO() const
+    int64_t getIOStartTime() const
     {
-        if( params.runUntilSteadyState )
-        {
-            if( steadyStateAchieved_ || steadyStateAssumedIOs_ )
-            {
-                return false;
-            }
-            else
-            {
-                return true;
-            }
-        }
-        
-        if( postedIOs_ < TOTAL_BLOCKS * numPasses_ )
-        {
-            return true;
-        }
+        return ioStartTime_;
+    }
 
-        return false;
+    int64_t getIOEndTime() const
+    {
+        return ioEndTime_;
     }
-    
-    bool allIOsCompleted()
+
+    bool getBuffersRegistered() const
     {
-        return ( shouldPostAnotherIO() == false ) && ( inFlight_ == 0 );
+        return buffersRegistered_;
     }
 
-    friend 
-        void CALLBACK ioCompletionRoutine( DWORD, DWORD, LPOVERLAPPED );
+    // In the order of their regions on the target
+    const vector<StreamStats> &getStreamStats() const
+    {
+        return streamStats_;
+    }
 
-    int64_t getRandomLegalDataBufferOffset() const
+    // Call before run(), with the same epoch for every worker
+    void setReplayEpoch( int64_t epoch )
     {
-        const int64_t MAX_LEGAL_SECTOR_OFFSET = MAX_IO_SIZE / SECTOR_SIZE;
+        replayEpoch_ = epoch;
+    }
 
-        uniform_int_distribution<int64_t> dist( 0, MAX_LEGAL_SECTOR_OFFSET );
+    const LatencyHistogram &getReplayLag() const
+    {
+        return replayLag_;
+    }
 
-        int64_t randomSectorOffset = dist( rngEngine );
+    // For -P.  How completions were polled for, once run() has begun.
+    string getPollingMode() const
+    {
+        return kernelPolled_ ? 
+            backend_->getKernelPolling() : "spin-then-sleep";
+    }
 
-        // Convert sector offset to byte offset
-        return randomSectorOffset * SECTOR_SIZE;
+    // -P's IOs by phase, also counted in the histograms above
+    const LatencyHistogram &getInterruptLatency() const
+    {
+        return interruptLatency_;
     }
 
-    int64_t getNextFileOffset() const
+    const LatencyHistogram &getPolledLatency() const
     {
-        int64_t nextBlockNum;
-       
-        if( params.accessPattern == SEQUENTIAL )
-        {
-            nextBlockNum = postedIOs_ % TOTAL_BLOCKS;
-        }
-        else
-        {
-            assert( params.accessPattern == RANDOM );
-        
-            const int64_t MAX_LEGAL_BLOCK = TOTAL_BLOCKS - 1;
+        return polledLatency_;
+    }
 
-            uniform_int_distribution<int64_t> dist( 0, MAX_LEGAL_BLOCK );
+    int64_t getMaxReapBatch() const
+    {
+        return MAX_REAP_BATCH;
+    }
 
-            nextBlockNum = dist( rngEngine );
-        }
-            
-        return nextBlockNum * params.blockSize;
+    int64_t getReapCalls() const
+    {
+        return reapCalls_;
     }
 
-    int64_t getIOSizeForFileOffset( LARGE_INTEGER offset ) const
+    // Trace time of the last record we replayed
+    double getLastRecordSeconds() const
     {
-        bool isLastBlock =
-            ( targetSize_ - offset.QuadPart ) < params.blockSize;
+        return lastRecordSeconds_;
+    }
 
-        if( isLastBlock )
-        {
-            return targetSize_ % params.blockSize;
-        }
+    int64_t getVerifiedSectors() const
+    {
+        return verifiedSectors_;
+    }
 
-        return params.blockSize;
+    int64_t getVerifyMismatches() const
+    {
+        return verifyMismatches_;
     }
 
-    bool shouldPostWrite()
+    void run()
     {
-        uniform_int_distribution<int64_t> dist( 1, 100 );
+        backend_->openTarget( TARGET.name, TARGET.rawDisk );
 
-        if( dist( rngEngine ) <= params.writePercentage )
+        buffersRegistered_ = backend_->registerBuffers( 
+            bufferPool.getBase(), bufferPool.getSize() );
+
+        if( POLLED )
         {
-            return true;
+            kernelPolled_ = !backend_->getKernelPolling().empty();
+
+            backend_->setKernelPolling( true );
         }
-        
-        return false;
-    }
 
-    void postNextIO( int64_t idx )
-    {
-        assert( idx < params.outstandingIOs );
-        
-        LARGE_INTEGER fileOffset;
-        fileOffset.QuadPart = getNextFileOffset();
-        
-        int64_t ioSize = getIOSizeForFileOffset( fileOffset );
+        ioStartTime_ = qpc();
+        batchWindowStart_ = ioStartTime_;
 
-        overlapped_[idx].Offset = fileOffset.LowPart;
-        overlapped_[idx].OffsetHigh = fileOffset.HighPart;
-  
-        if( shouldPostWrite() )
+        if( PACED )
         {
-            // Defeat de-duplication.
-            // This is safe because buffer is 2x MAX_IO_SIZE.
-            //
-            // ISSUE-REVIEW: we might pick the same offset twice.
-            // Should we just round-robin instead?
-            int64_t dataBufferOffset = getRandomLegalDataBufferOffset();
-
-            checkedWriteFileEx(
-                    targetHandle_,
-                    &writeDataBuffer[dataBufferOffset],
-                    ioSize,
-                    &overlapped_[idx],
-                    &ioCompletionRoutine );
+            startPacing();
         }
         else
         {
-            checkedReadFileEx(
-                    targetHandle_,
-                    &readDataBuffers[idx][0],
-                    ioSize,
-                    &overlapped_[idx],
-                    &ioCompletionRoutine );
+            // Kick off initial IOs
+            for( int64_t i = 0; 
+                    ( i < QUEUE_DEPTH ) && shouldPostAnotherIO(); ++i )
+            {
+                postNextIO( i );
+            }
         }
 
-        inFlight_++;
-    
-        assert( inFlight_ <= params.outstandingIOs );
-        
+        while( !allIOsCompleted() )
+        {
+            int64_t timeout = IOBackend::WAIT_FOREVER;
+
+            if( PACED )
+            {
+                timeout = postPacedIOs();
+
+                if( inFlight_ == 0 )
+                {
+                    // Nothing to reap, just wait for tokens
+                    this_thread::sleep_for( chrono::nanoseconds( timeout ) );
+                    continue;
+                }
+            }
+
+            completions_.clear();
+
+            reapCompletions( timeout );
+
+            // Everything in the batch was reaped just now.  One clock
+            // read per batch rather than per IO.
+            int64_t now = qpc();
+
+            for( auto &c: completions_ )
+            {
+                handleCompletion( c, now );
+            }
+
+            adaptReapBatch( now );
+
+            if( switchingPhase_ && ( inFlight_ == 0 ) )
+            {
+                switchPhase();
+            }
+
+            publishStats();
+        }
+
+        ioEndTime_ = qpc();
+
+        // We are now finshed writing
+
+        backend_->flush();
+
+        doFinalSanityChecks();
+
+        if( params.verify )
+        {
+            runVerifyPass();
+        }
+
+        backend_->closeTarget();
+
+        stats_.finished.store( true, memory_order_release );
+    }
+
+    private:
+
+    void doFinalSanityChecks() const
+    {
+        assert( inFlight_ == 0 );
+        assert( shouldPostAnotherIO() == false );
+
+        if( !params.runUntilSteadyState && !trace_ && !SHARED_STREAM )
+        {
+            assert( completedBytes_ + completedDiscardBytes_ == 
+                SLICE_BYTES * numPasses_ );
+        }
+    }
+
+    void publishStats()
+    {
+        stats_.completedIOs.store( completedIOs_, memory_order_relaxed );
+        stats_.completedBytes.store( completedBytes_, memory_order_relaxed );
+        stats_.readBytes.store( 
+            completedBytes_ - completedWriteBytes_, memory_order_relaxed );
+        stats_.writeBytes.store( completedWriteBytes_, memory_order_relaxed );
+        stats_.discardBytes.store( 
+            completedDiscardBytes_, memory_order_relaxed );
+
+        if( trace_ )
+        {
+            stats_.traceBytes.store( 
+                trace_->getBytesParsed(), memory_order_relaxed );
+        }
+    }
+
+    bool shouldPostAnotherIO() const
+    {
+        if( trace_ )
+        {
+            return haveRecord_;
+        }
+
+        if( params.runUntilSteadyState )
+        {
+            // IOEngine decides when we have reached steady-state
+            return !stopRequested_.load( memory_order_relaxed );
+        }
+
+        if( SHARED_STREAM )
+        {
+            // Say no only once the other workers have claimed all of
+            // the stream.  postNextIO makes the claim.
+            return accessGenerator_->hasNext();
+        }
+
+        if( postedBytes_ < SLICE_BYTES * numPasses_ )
+        {
+            return true;
+        }
+
+        return false;
+    }
+
+    bool allIOsCompleted()
+    {
+        return ( shouldPostAnotherIO() == false ) && ( inFlight_ == 0 );
+    }
+
+    void startPacing()
+    {
+        int64_t now = qpc();
+
+        if( params.targetIOPS > 0 )
+        {
+            iopsBucket_ = TokenBucket( 
+                params.targetIOPS * RATE_SHARE, QPC_TICKS_PER_SEC, now );
+        }
+
+        if( params.targetMBps > 0 )
+        {
+            bandwidthBucket_ = TokenBucket( 
+                params.targetMBps * 1024 * 1024 * RATE_SHARE, 
+                QPC_TICKS_PER_SEC, 
+                now );
+        }
+
+        // Reversed, so slot 0 goes first
+        for( int64_t i = QUEUE_DEPTH - 1; i >= 0; --i )
+        {
+            idleSlots_.push_back( i );
+        }
+    }
+
+    // Posts to idle slots as fast as the buckets allow.  Returns how
+    // many nanoseconds until they allow another, or WAIT_FOREVER if no
+    // slot is waiting.
+    int64_t postPacedIOs()
+    {
+        while( !idleSlots_.empty() && shouldPostAnotherIO() && 
+                !switchingPhase_ )
+        {
+            int64_t now = qpc();
+
+            int64_t wait = max( getTicksUntilDue( now ), max( 
+                iopsBucket_.getTicksUntilReady( now ),
+                bandwidthBucket_.getTicksUntilReady( now ) ) );
+
+            if( wait > 0 )
+            {
+                return static_cast<int64_t>( ticksToNanoseconds( wait ) );
+            }
+
+            postNextIO( idleSlots_.back() );
+
+            idleSlots_.pop_back();
+        }
+
+        return IOBackend::WAIT_FOREVER;
+    }
+
+    int64_t getDueTime( const TraceRecord &record ) const
+    {
+        return replayEpoch_ + static_cast<int64_t>( 
+            record.seconds / params.replaySpeed * QPC_TICKS_PER_SEC );
+    }
+
+    int64_t getTicksUntilDue( int64_t now ) const
+    {
+        if( !trace_ || ( params.replaySpeed == 0 ) ) return 0;
+
+        return getDueTime( nextRecord_ ) - now;
+    }
+
+    int64_t getRandomLegalDataBufferOffset()
+    {
+        // O_DIRECT wants buffers aligned like the target's sectors
+        const int64_t SECTOR = GEOMETRY.logicalSectorSize;
+        const int64_t MAX_LEGAL_SECTOR_OFFSET = 
+            ( BufferPool::WRITE_BUFFER_BYTES - MAX_IO_SIZE ) / SECTOR;
+
+        uniform_int_distribution<int64_t> dist( 0, MAX_LEGAL_SECTOR_OFFSET );
+
+        int64_t randomSectorOffset = dist( rngEngine_ );
+
+        // Convert sector offset to byte offset
+        return randomSectorOffset * SECTOR;
+    }
+
+    // Picks the kind, size and location of the next IO
+    void chooseNextIO( IORequest &request )
+    {
+        if( trace_ )
+        {
+            chooseNextTraceIO( request );
+            return;
+        }
+
+        chooseOperation( request );
+
+        const BlockSizeDistribution &sizes = 
+            ( request.isWrite || request.isDiscard ) ? 
+                params.writeSizes : params.readSizes;
+
+        request.bytes = sizes( rngEngine_ );
+        request.offset = accessGenerator_->next( request.bytes );
+
+        // Don't run past the end of the target...
+        request.bytes = min( request.bytes, SLICE_END - request.offset );
+
+        // ...or past the end of the last pass
+        if( !params.runUntilSteadyState )
+        {
+            request.bytes = min( request.bytes, 
+                SLICE_BYTES * numPasses_ - postedBytes_ );
+        }
+    }
+
+    // Takes the next record.  A trace from a larger device wraps
+    // around our target.
+    void chooseNextTraceIO( IORequest &request )
+    {
+        assert( haveRecord_ );
+
+        if( params.replaySpeed > 0 )
+        {
+            int64_t late = qpc() - getDueTime( nextRecord_ );
+
+            replayLag_.record( ticksToNanoseconds( max<int64_t>( late, 0 ) ) );
+        }
+
+        request.isWrite = nextRecord_.isWrite;
+        request.isDiscard = nextRecord_.isDiscard;
+
+        // Both sector multiples, so the offset stays aligned
+        request.bytes = min( nextRecord_.bytes, targetSize_ );
+        request.offset = nextRecord_.offset % targetSize_;
+
+        if( request.offset + request.bytes > targetSize_ )
+        {
+            request.offset = targetSize_ - request.bytes;
+        }
+
+        lastRecordSeconds_ = nextRecord_.seconds;
+
+        haveRecord_ = trace_->next( nextRecord_ );
+    }
+
+    bool isWritten( int64_t offset, int64_t bytes ) const
+    {
+        int64_t first = ( offset - SLICE_START ) / VERIFY_GRAIN;
+        int64_t last = ( offset + bytes - 1 - SLICE_START ) / VERIFY_GRAIN;
+
+        for( int64_t i = first; i <= last; ++i )
+        {
+            if( !writtenGrains_[i] ) return false;
+        }
+
+        return true;
+    }
+
+    void markWritten( int64_t offset, int64_t bytes )
+    {
+        int64_t first = ( offset - SLICE_START ) / VERIFY_GRAIN;
+        int64_t last = ( offset + bytes - 1 - SLICE_START ) / VERIFY_GRAIN;
+
+        for( int64_t i = first; i <= last; ++i )
+        {
+            writtenGrains_[i] = true;
+        }
+    }
+
+    int64_t getIOSizeForFileOffset( int64_t offset ) const
+    {
+        bool isLastBlock =
+            ( targetSize_ - offset ) < params.blockSize;
+
+        if( isLastBlock )
+        {
+            return targetSize_ % params.blockSize;
+        }
+
+        return params.blockSize;
+    }
+
+    // One roll, so -w and -D are both percentages of all IOs
+    void chooseOperation( IORequest &request )
+    {
+        uniform_int_distribution<int64_t> dist( 1, 100 );
+
+        int64_t roll = dist( rngEngine_ );
+
+        request.isWrite = ( roll <= params.writePercentage );
+
+        request.isDiscard = !request.isWrite && ( roll <= 
+            params.writePercentage + params.discardPercentage );
+    }
+
+    void postNextIO( int64_t idx )
+    {
+        assert( idx < QUEUE_DEPTH );
+
+        // With -si, the other workers may have claimed the rest of the
+        // stream since shouldPostAnotherIO().  The slot then stays idle,
+        // and shouldPostAnotherIO() now says no.
+        if( !accessGenerator_->claimNext() ) return;
+
+        IORequest request;
+
+        request.slot = idx;
+
+        chooseNextIO( request );
+
+        if( request.isDiscard )
+        {
+            request.buffer = NULL;
+        }
+        else if( request.isWrite && params.verify )
+        {
+            // The slot's buffer is ours until this IO completes
+            request.buffer = bufferPool.getSlot( SLOT_BASE + idx );
+
+            stampVerifyBlocks( 
+                static_cast<uint8_t *>( request.buffer ),
+                request.bytes,
+                request.offset,
+                postedBytes_ / SLICE_BYTES,
+                PAYLOAD_NONCE,
+                getIoId() );
+        }
+        else if( request.isWrite && params.uniquePayloads )
+        {
+            // The slot's buffer is ours until this IO completes
+            request.buffer = bufferPool.getSlot( SLOT_BASE + idx );
+
+            fillPayload( request );
+        }
+        else if( request.isWrite )
+        {
+            // Defeat de-duplication.
+            // This is safe because buffer is 2x the largest IO.
+            //
+            // ISSUE-REVIEW: we might pick the same offset twice.
+            // Should we just round-robin instead?
+            int64_t dataBufferOffset = getRandomLegalDataBufferOffset();
+
+            request.buffer = 
+                bufferPool.getWriteBuffer().begin() + dataBufferOffset;
+        }
+        else
+        {
+            request.buffer = bufferPool.getSlot( SLOT_BASE + idx );
+        }
+
+        slots_[idx].isWrite = request.isWrite;
+        slots_[idx].isDiscard = request.isDiscard;
+        slots_[idx].offset = request.offset;
+        slots_[idx].bytes = request.bytes;
+        slots_[idx].mustBeCurrent = params.verify && 
+            isWritten( request.offset, request.bytes );
+        slots_[idx].submitTime = qpc();
+
+        if( !streamStats_.empty() )
+        {
+            slots_[idx].stream = getStream( request.offset );
+
+            StreamStats &stream = streamStats_[ slots_[idx].stream ];
+
+            if( stream.firstSubmitTime == 0 )
+            {
+                stream.firstSubmitTime = slots_[idx].submitTime;
+            }
+        }
+
+        iopsBucket_.spend( 1 );
+
+        // Nothing crosses the bus for a discard
+        if( !request.isDiscard ) bandwidthBucket_.spend( request.bytes );
+
+        backend_->submit( request );
+
+        inFlight_++;
+
+        assert( inFlight_ <= QUEUE_DEPTH );
+
         postedIOs_++;
+        postedBytes_ += request.bytes;
+
+        if( POLLED && ( ++phaseIOs_ == POLL_PHASE_IOS ) )
+        {
+            if( kernelPolled_ )
+            {
+                switchingPhase_ = true;
+            }
+            else
+            {
+                startNextPhase();
+            }
+        }
+    }
+
+    // With -P and a backend that can't poll the device itself, we spin
+    // on reap() a while before sleeping in it.  That still takes the
+    // interrupt, but not the wakeup.
+    void reapCompletions( int64_t timeoutNanoseconds )
+    {
+        if( POLLED && !kernelPolled_ && !interruptPhase_ )
+        {
+            int64_t spinNanoseconds = 
+                ( timeoutNanoseconds == IOBackend::WAIT_FOREVER ) ?
+                    MAX_SPIN_NANOSECONDS : 
+                    min( timeoutNanoseconds, MAX_SPIN_NANOSECONDS );
+
+            int64_t start = qpc();
+            int64_t spun = 0;
+
+            do
+            {
+                if( backend_->reap( completions_, 0 ) > 0 )
+                {
+                    reapCalls_++;
+                    return;
+                }
+
+                spun = static_cast<int64_t>( 
+                    ticksToNanoseconds( qpc() - start ) );
+            }
+            while( spun < spinNanoseconds );
+
+            if( timeoutNanoseconds != IOBackend::WAIT_FOREVER )
+            {
+                timeoutNanoseconds = max<int64_t>( 
+                    0, timeoutNanoseconds - spun );
+            }
+        }
+
+        reapCalls_++;
+
+        backend_->reap( completions_, timeoutNanoseconds, reapBatch_ );
+    }
+
+    // A simple hill climb.  IOPS are noisy, so the batch wanders a
+    // little around the best size rather than settling on it.
+    void adaptReapBatch( int64_t now )
+    {
+        if( MAX_REAP_BATCH == 1 ) return;
+
+        int64_t elapsed = now - batchWindowStart_;
+
+        if( elapsed < REAP_BATCH_WINDOW_MS * QPC_TICKS_PER_SEC / 1000 ) return;
+
+        double iops = static_cast<double>( completedIOs_ - batchWindowIOs_ ) * 
+            QPC_TICKS_PER_SEC / elapsed;
+
+        if( iops < batchWindowIOPS_ )
+        {
+            reapBatchGrowing_ = !reapBatchGrowing_;
+        }
+
+        reapBatch_ = reapBatchGrowing_ ? 
+            min( reapBatch_ * 2, MAX_REAP_BATCH ) : 
+            max<int64_t>( reapBatch_ / 2, 1 );
+
+        batchWindowStart_ = now;
+        batchWindowIOs_ = completedIOs_;
+        batchWindowIOPS_ = iops;
+    }
+
+    void startNextPhase()
+    {
+        phaseCount_++;
+        phaseIOs_ = 0;
+
+        interruptPhase_ = ( phaseCount_ % INTERRUPT_PHASE_PERIOD == 
+            INTERRUPT_PHASE_PERIOD - 1 );
+    }
+
+    // Starts the next -P phase on a kernel-polled backend, once the
+    // last one has drained
+    void switchPhase()
+    {
+        assert( inFlight_ == 0 );
+
+        switchingPhase_ = false;
+
+        startNextPhase();
+
+        backend_->setKernelPolling( !interruptPhase_ );
+
+        // Paced slots wait for the buckets as usual
+        if( PACED ) return;
+
+        while( !idleSlots_.empty() && shouldPostAnotherIO() )
+        {
+            postNextIO( idleSlots_.back() );
+
+            idleSlots_.pop_back();
+        }
+    }
+
+    int64_t getStream( int64_t offset ) const
+    {
+        return upper_bound( 
+            STREAM_BOUNDS.begin(), STREAM_BOUNDS.end(), offset ) - 
+            STREAM_BOUNDS.begin() - 1;
+    }
+
+    // Slot bases differ between workers, so IO ids never collide
+    uint64_t getIoId() const
+    {
+        return ( static_cast<uint64_t>( SLOT_BASE ) << 40 ) | 
+            static_cast<uint64_t>( postedIOs_ );
+    }
+
+    void fillPayload( const IORequest &request )
+    {
+        int64_t start = qpc();
+
+        fillUniquePayload( 
+            static_cast<uint8_t *>( request.buffer ), 
+            request.bytes, 
+            PAYLOAD_NONCE, 
+            getIoId() );
+
+        payloadTicks_ += qpc() - start;
+        payloadBytes_ += request.bytes;
+    }
+
+    void handleCompletion( const IOCompletion &completion, int64_t now )
+    {
+        // First priority: post the next IO
+        // Second priority: track stats for the just-completed IO
+        //
+        // The idea is to come as close as possible to attaining
+        // the requested queue depth.
+
+        if( completion.error )
+        {
+            cerr
+                << endl << "IO failed to complete. Error: "
+                << completion.error << endl;
+
+            exit( EXIT_FAILURE );
+        }
+
+        inFlight_--;
+
+        // Must read the slot before postNextIO reuses it
+        const SlotState &slot = slots_[completion.slot];
+
+        // A discard succeeds or fails as a whole, and not every backend
+        // reports its length (fallocate returns 0)
+        int64_t bytes = slot.isDiscard ? slot.bytes : completion.bytes;
+
+        completedIOs_++;
+
+        if( slot.isDiscard )
+        {
+            completedDiscards_++;
+            completedDiscardBytes_ += bytes;
+        }
+        else
+        {
+            completedBytes_ += bytes;
+
+            if( slot.isWrite ) completedWriteBytes_ += bytes;
+        }
+
+        if( !streamStats_.empty() && !slot.isDiscard )
+        {
+            StreamStats &stream = streamStats_[ slot.stream ];
+
+            stream.completedBytes += bytes;
+            stream.lastCompletionTime = now;
+        }
+
+        uint64_t latency = ticksToNanoseconds( now - slot.submitTime );
+
+        LatencyHistogram &histogram = 
+            slot.isDiscard ? discardLatency_ :
+            slot.isWrite ? writeLatency_ : readLatency_;
+
+        // Read before postNextIO can start another phase.  Spinning
+        // ourselves, the IO belongs to the phase that reaped it; with
+        // kernel polling, phases only change with nothing in flight,
+        // so that's also the one that submitted it.
+        LatencyHistogram &phaseHistogram = 
+            interruptPhase_ ? interruptLatency_ : polledLatency_;
+
+        if( params.verify )
+        {
+            // Must check reads before postNextIO reuses the buffer
+            handleVerifyCompletion( completion, slot );
+        }
+
+        if( shouldPostAnotherIO() )
+        {
+            if( PACED || switchingPhase_ )
+            {
+                // run() posts it when the buckets allow, or the next
+                // phase starts
+                idleSlots_.push_back( completion.slot );
+            }
+            else
+            {
+                postNextIO( completion.slot );
+            }
+        }
+
+        histogram.record( latency );
+
+        if( POLLED ) phaseHistogram.record( latency );
+    }
+
+    void handleVerifyCompletion( 
+            const IOCompletion &completion, 
+            const SlotState &slot )
+    {
+        if( slot.isWrite )
+        {
+            markWritten( slot.offset, slot.bytes );
+            return;
+        }
+
+        checkRead( 
+            bufferPool.getSlot( SLOT_BASE + completion.slot ), 
+            slot.offset, 
+            slot.bytes, 
+            slot.mustBeCurrent );
+    }
+
+    void checkRead( 
+            const uint8_t *buffer, 
+            int64_t offset, 
+            int64_t bytes, 
+            bool mustBeCurrent )
+    {
+        size_t alreadyReported = mismatchReports_.size();
+
+        verifyMismatches_ += checkVerifyBlocks( 
+            buffer,
+            bytes,
+            offset,
+            PAYLOAD_NONCE,
+            mustBeCurrent,
+            mismatchReports_,
+            MAX_REPORTED_MISMATCHES );
+
+        verifiedSectors_ += bytes / SECTOR_SIZE;
+
+        for( size_t i = alreadyReported; i < mismatchReports_.size(); ++i )
+        {
+            // One insertion, so lines from other workers don't interleave
+            cerr << ( "\n" + 
+                describeVerifyMismatch( mismatchReports_[i] ) + "\n" );
+        }
+    }
+
+    // Reads back our whole slice once the workload is done.  Blocks we
+    // wrote must hold exactly what we last wrote; the rest must at least
+    // be intact, if they carry a header at all.
+    void runVerifyPass()
+    {
+        int64_t nextBlock = 0;
+        int64_t inFlight = 0;
+
+        auto postRead = [&]( int64_t slot )
+        {
+            IORequest request;
+
+            request.slot = slot;
+            request.isWrite = false;
+            request.isDiscard = false;
+            request.offset = ( FIRST_BLOCK + nextBlock ) * params.blockSize;
+            request.bytes = getIOSizeForFileOffset( request.offset );
+            request.buffer = bufferPool.getSlot( SLOT_BASE + slot );
+
+            slots_[slot].offset = request.offset;
+            slots_[slot].bytes = request.bytes;
+
+            backend_->submit( request );
+
+            nextBlock++;
+            inFlight++;
+        };
+
+        for( int64_t i = 0; i < min( NUM_BLOCKS, QUEUE_DEPTH ); ++i )
+        {
+            postRead( i );
+        }
+
+        while( inFlight > 0 )
+        {
+            completions_.clear();
+
+            backend_->reap( completions_ );
+
+            for( auto &c: completions_ )
+            {
+                if( c.error )
+                {
+                    cerr
+                        << endl << "Verify read failed. Error: "
+                        << c.error << endl;
+
+                    exit( EXIT_FAILURE );
+                }
+
+                inFlight--;
+
+                const SlotState &slot = slots_[c.slot];
+
+                // Nothing else is in flight, so each grain can be
+                // judged by whether it has been written
+                for( int64_t done = 0; done < slot.bytes; 
+                        done += VERIFY_GRAIN )
+                {
+                    int64_t offset = slot.offset + done;
+                    int64_t bytes = min( VERIFY_GRAIN, slot.bytes - done );
+
+                    checkRead( 
+                        bufferPool.getSlot( SLOT_BASE + c.slot ) + done, 
+                        offset, 
+                        bytes, 
+                        isWritten( offset, bytes ) );
+                }
+
+                if( nextBlock < NUM_BLOCKS )
+                {
+                    postRead( c.slot );
+                }
+            }
+        }
+    }
+};
+
+// Where the workers run and their buffers live
+struct Placement
+{
+    int node; // NO_NODE if we aren't placing anything
+    string reason; // Why not, if so
+    vector<int> cpus; // One per worker
+    bool buffersBound;
+    int64_t nodeFreeBytes;
+
+    Placement()
+        : node( NO_NODE )
+        , buffersBound( false )
+        , nodeFreeBytes( 0 )
+    {}
+};
+
+// Far from the device, each completion crosses the socket interconnect,
+// so by default we stay on the device's node.  Workers get a physical
+// core each, as long as the node has enough.
+Placement planPlacement( int numThreads )
+{
+    Placement placement;
+
+    if( params.numaNode == NUMA_OFF )
+    {
+        placement.reason = "-Noff";
+        return placement;
+    }
+
+    int node = params.numaNode;
+
+    if( node == NUMA_AUTO )
+    {
+        // Nothing is far away with one node
+        if( getNumNodes() < 2 )
+        {
+            placement.reason = "one NUMA node";
+            return placement;
+        }
+
+        node = getTargetNode( params.targets[0].name );
+
+        if( node == NO_NODE )
+        {
+            placement.reason = "target's node unknown";
+            return placement;
+        }
+
+        // One pool of buffers can only be near one node
+        for( auto &t: params.targets )
+        {
+            if( getTargetNode( t.name ) != node )
+            {
+                placement.reason = "targets on different nodes";
+                return placement;
+            }
+        }
+    }
+
+    vector<int> cpus = orderByCore( getNodeCpus( node ) );
+
+    if( cpus.empty() )
+    {
+        cerr << "Error: no CPUs we may use on NUMA node " << node << endl;
+        exit( EXIT_FAILURE );
+    }
+
+    placement.node = node;
+    placement.nodeFreeBytes = getNodeFreeBytes( node );
+
+    for( int i = 0; i < numThreads; ++i )
+    {
+        placement.cpus.push_back( cpus[i % cpus.size()] );
+    }
+
+    return placement;
+}
+
+// Binds the pool to the node, then faults and locks it in.  Locking
+// is only an error with -K, since the default ulimit -l is small.
+void placeBuffers( Placement &placement )
+{
+    size_t bytes = bufferPool.getSize();
+
+    if( placement.node != NO_NODE )
+    {
+        if( placement.nodeFreeBytes < static_cast<int64_t>( bytes ) )
+        {
+            cerr << "Warning: NUMA node " << placement.node 
+                << " is short of memory, buffers may be allocated elsewhere\n";
+        }
+        else
+        {
+            placement.buffersBound = bindMemoryToNode( 
+                bufferPool.getBase(), bytes, placement.node );
+        }
+    }
+
+    bufferPool.prefault();
+
+    if( !bufferPool.lock() && params.lockBuffers )
+    {
+        cerr << "Error: couldn't lock " << bytes / 1024 
+            << " KB of buffers in memory (check ulimit -l)\n";
+        exit( EXIT_FAILURE );
+    }
+}
+
+// Runs first on each worker thread
+void placeWorkerThread( const Placement &placement, int64_t worker )
+{
+    if( !placement.cpus.empty() && 
+            !pinCurrentThread( placement.cpus[worker] ) )
+    {
+        cerr << "Error: couldn't pin a worker to CPU " 
+            << placement.cpus[worker] << endl;
+        exit( EXIT_FAILURE );
+    }
+
+    // Linux threads inherit this from main, but Windows threads don't
+    if( params.realTime ) setRealTimePriority();
+}
+
+// polled asks for a backend that can poll for completions (-P)
+unique_ptr<IOBackend> createIOBackend(
+        const string &name,
+        int64_t queueDepth,
+        bool polled = false )
+{
+#ifdef _WIN32
+    if( name == "win32" )
+    {
+        return unique_ptr<IOBackend>( new Win32Backend( queueDepth ) );
+    }
+#else
+    if( name == "auto" )
+    {
+        // Fastest first.  Each can be compiled in but unavailable
+        // at runtime: old kernels, seccomp filters, container limits.
+        if( IoUringBackend::isSupported() )
+        {
+            return createIOBackend( "io_uring", queueDepth, polled );
+        }
+        else if( LibaioBackend::isSupported() )
+        {
+            return createIOBackend( "libaio", queueDepth );
+        }
+
+        return createIOBackend( "psync", queueDepth );
+    }
+    else if( name == "io_uring" )
+    {
+        return unique_ptr<IOBackend>( 
+            new IoUringBackend( queueDepth, polled ) );
+    }
+    else if( name == "libaio" )
+    {
+        return unique_ptr<IOBackend>( new LibaioBackend( queueDepth ) );
+    }
+    else if( name == "psync" )
+    {
+        return unique_ptr<IOBackend>( new PsyncBackend( queueDepth ) );
+    }
+#endif
+
+    cerr << "Error: unknown IO backend: " << name << endl;
+    exit( EXIT_FAILURE );
+}
+
+// e.g. "io backend io_uring used 1.23 CPU seconds, 4.56 us per IO, 2
+// thread(s)"
+string describeBackendCost( 
+        const string &backendName,
+        double cpuSeconds, 
+        int64_t ios, 
+        int64_t numThreads )
+{
+    double cpuMicrosecondsPerIO = ( ios > 0 ) ? cpuSeconds * 1e6 / ios : 0;
+
+    ostringstream msg;
+
+    msg.setf( std::ios::fixed );
+    msg.precision( 2 );
+
+    msg << "io backend " << backendName
+        << " used " << cpuSeconds << " CPU seconds, "
+        << cpuMicrosecondsPerIO << " us per IO, "
+        << numThreads << " thread(s)";
+
+    return msg.str();
+}
+
+// Runs one IOGenerator per worker thread, each with its own backend,
+// queue, and slice of one target.  The engines' owner never touches
+// the IO path; it just has each sample its workers' counters, to drive
+// the progress message and the single, target-wide, steady-state
+// detector.
+class IOEngine
+{
+    private:
+
+    const TargetSpec TARGET;
+    const int64_t TARGET_INDEX; // Among params.targets
+
+    // Our workers' places in the placement and our slots' in the pool
+    // follow those of the targets before us
+    const int64_t FIRST_WORKER;
+
+    int64_t targetSize_;
+    const TargetGeometry GEOMETRY;
+    const Placement PLACEMENT;
+    int numPasses_;
+
+    const int64_t TOTAL_BLOCKS;
+    const int64_t NUM_THREADS;
+    const int64_t NUM_STREAMS; // For -k, else 0
+
+    const int64_t MAX_STEADY_STATE_IOS;
+
+    // For -R.  Declared first so it outlives the workers' readers.
+    TraceFile trace_;
+
+    // For -si.  Likewise, outlives the workers that claim from it.
+    // Unused without -si.
+    SharedCursor sharedCursor_;
+
+    vector< WorkerStats > workerStats_;
+    vector< unique_ptr<IOGenerator> > generators_;
+    vector< thread > threads_;
+    atomic<bool> stopRequested_;
+
+    int64_t completedIOs_;
+    int64_t completedBytes_;
+    int64_t completedDiscardBytes_; // For progress, not bandwidth
+
+    bool steadyStateAchieved_;
+    bool steadyStateAssumedIOs_;
+    bool reportedComplete_;
+
+    int64_t qpcStart_;
+    double cpuStart_;
+
+    double measuredCompressibility_;
+
+    // Shared by all workers' unique payloads, for this run only
+    const uint64_t PAYLOAD_NONCE;
+
+    SteadyStateDetector steadyStateDetector_;
+    ThroughputMeter throughputMeter_;
+
+    // Cumulative latency of all workers, as of the last latency window
+    LatencyHistogram latencySnapshot_;
+    LatencyHistogram latencyCurrent_;
+    LatencyHistogram latencyWindow_;
+
+    // For -L.  Cumulative counts as of the last interval we logged.
+    TimeSeriesPyramid timeSeries_;
+    const int64_t SAMPLE_TICKS;
+    int64_t seriesStart_;
+    int64_t lastSampleTime_;
+    int64_t seriesReadBytes_;
+    int64_t seriesWriteBytes_;
+    LatencyHistogram seriesReadLatency_;
+    LatencyHistogram seriesWriteLatency_;
+
+    // Where we're at, for the owner's status line.  progressDue_ says
+    // not to sit on it: we just finished, or reached steady-state.
+    string progress_;
+    bool progressDue_;
+
+    public:
+
+    // How often the owner should call monitor().  SteadyStateDetector
+    // spreads each sample over the bins it spans, so this need not
+    // divide evenly into a bin.
+    static const int MONITOR_PERIOD_MS = 10;
+
+    IOEngine(
+            const TargetSpec &target,
+            int64_t targetIndex,
+            int64_t targetSize,
+            const TargetGeometry &geometry,
+            const Placement &placement,
+            int numPasses,
+            int64_t numThreads )
+        : TARGET( target )
+        , TARGET_INDEX( targetIndex )
+        , FIRST_WORKER( targetIndex * params.numThreads )
+        , targetSize_( targetSize )
+        , GEOMETRY( geometry )
+        , PLACEMENT( placement )
+        , numPasses_( numPasses )
+        , TOTAL_BLOCKS( divRoundUp( targetSize, params.blockSize ) )
+        , NUM_THREADS(
+            max<int64_t>( 1, min<int64_t>( numThreads, TOTAL_BLOCKS ) ) )
+        , NUM_STREAMS( min<int64_t>( params.numStreams, TOTAL_BLOCKS ) )
+        , MAX_STEADY_STATE_IOS( // ~2 overwrites
+            2 * divRoundUp( targetSize, llround( getMeanIOSize() ) ) )
+        , sharedCursor_( 
+            targetSize, 
+            getSharedClaimBytes(), 
+            params.runUntilSteadyState ? 0 : numPasses )
+        , workerStats_( NUM_THREADS )
+        , stopRequested_( false )
+        , completedIOs_( 0 )
+        , completedBytes_( 0 )
+        , completedDiscardBytes_( 0 )
+        , steadyStateAchieved_( false )
+        , steadyStateAssumedIOs_( false )
+        , reportedComplete_( false )
+        , qpcStart_( qpc() )
+        , cpuStart_( cpuSecondsUsed() )
+        , PAYLOAD_NONCE( 
+            ( static_cast<uint64_t>( rngEngine() ) << 32 ) ^ qpc() )
+        , steadyStateDetector_(
+                params.steadyStateGatherSec,
+                params.steadyStateDwellSec,
+                params.steadyStateTolerance,
+                // Keep the slope tolerance in IOs when binning bytes
+                ( params.steadyStateMetric == IOS_METRIC ) ? 
+                    1 : getMeanIOSize(),
+                ( params.steadyStateMetric == LATENCY_METRIC ) ?
+                    params.latencyTolerance : 0,
+                params.steadyStatePolicy )
+        , SAMPLE_TICKS( 
+            params.timeSeriesIntervalMs * QPC_TICKS_PER_SEC / 1000 )
+        , seriesStart_( 0 )
+        , lastSampleTime_( 0 )
+        , seriesReadBytes_( 0 )
+        , seriesWriteBytes_( 0 )
+        , progressDue_( false )
+    {
+        // We will reuse this write buffer over and over with a
+        // random offset. Should be enough entropy to defeat compression,
+        // unless -c asked for some compressibility.
+        //
+        // N.B: Earlier attempts generated new random data
+        // for each IO, and ended up CPU-limited.
+        ByteSpan writeBuffer = bufferPool.getWriteBuffer();
+
+        measuredCompressibility_ = 
+            fillCompressibleBuffer( writeBuffer, params.compressibility );
+
+#ifndef NDEBUG
+        ByteSpan slots = bufferPool.getSlots();
+
+        fill( slots.begin(), slots.end(), 0xFF );
+#endif
+        if( !params.traceFile.empty() )
+        {
+            trace_.open( params.traceFile, GEOMETRY.logicalSectorSize );
+        }
+
+        int64_t slotBase = TARGET_INDEX * params.outstandingIOs;
+
+        for( int64_t i = 0; i < NUM_THREADS; ++i )
+        {
+            // Shard both the blocks and the queue depth evenly.  Any
+            // remainder goes to the lowest-numbered workers.
+            int64_t firstBlock = TOTAL_BLOCKS * i / NUM_THREADS;
+            int64_t lastBlock = TOTAL_BLOCKS * ( i + 1 ) / NUM_THREADS;
+
+            // ...unless they share one stream over the whole target
+            if( params.sharedStream )
+            {
+                firstBlock = 0;
+                lastBlock = TOTAL_BLOCKS;
+            }
+
+            // With -k, shard the streams instead.  Each worker's slice is
+            // then its streams' regions, end to end.
+            vector<int64_t> streamBounds;
+
+            if( NUM_STREAMS > 0 )
+            {
+                int64_t firstStream = NUM_STREAMS * i / NUM_THREADS;
+                int64_t lastStream = NUM_STREAMS * ( i + 1 ) / NUM_THREADS;
+
+                for( int64_t j = firstStream; j <= lastStream; ++j )
+                {
+                    streamBounds.push_back( min( 
+                        getStreamFirstBlock( j ) * params.blockSize, 
+                        targetSize_ ) );
+                }
+
+                firstBlock = getStreamFirstBlock( firstStream );
+                lastBlock = getStreamFirstBlock( lastStream );
+            }
+
+            int64_t queueDepth = ( params.outstandingIOs / NUM_THREADS ) +
+                ( i < ( params.outstandingIOs % NUM_THREADS ) ? 1 : 0 );
+
+            // Each worker replays its own piece of the trace, with the
+            // times in it relative to the start of the whole trace
+            unique_ptr<TraceReader> trace;
+
+            if( !params.traceFile.empty() )
+            {
+                trace.reset( new TraceReader( 
+                    trace_, 
+                    trace_.getPieceStart( i, NUM_THREADS ),
+                    trace_.getPieceStart( i + 1, NUM_THREADS ) ) );
+            }
+
+            generators_.push_back( unique_ptr<IOGenerator>(
+                new IOGenerator(
+                    createIOBackend( 
+                        params.ioBackend, queueDepth, params.polled ),
+                    TARGET,
+                    targetSize_,
+                    GEOMETRY,
+                    numPasses_,
+                    firstBlock,
+                    lastBlock - firstBlock,
+                    slotBase,
+                    queueDepth,
+                    workerStats_[i],
+                    stopRequested_,
+                    PAYLOAD_NONCE,
+                    // Same share of the rate as of the target, so
+                    // every worker finishes at the same time
+                    params.sharedStream ? 1.0 / NUM_THREADS :
+                        static_cast<double>( lastBlock - firstBlock ) / 
+                            TOTAL_BLOCKS,
+                    move( trace ),
+                    params.sharedStream ? &sharedCursor_ : NULL,
+                    streamBounds ) ) );
+
+            slotBase += queueDepth;
+        }
+    }
+
+    // Launches the workers
+    void start()
+    {
+        seriesStart_ = lastSampleTime_ = qpc();
+
+        for( auto &g: generators_ )
+        {
+            g->setReplayEpoch( seriesStart_ );
+        }
+
+        for( size_t i = 0; i < generators_.size(); ++i )
+        {
+            IOGenerator *g = generators_[i].get();
+            const Placement &placement = PLACEMENT;
+            int64_t worker = FIRST_WORKER + i;
+
+            threads_.push_back( thread( [g, &placement, worker]()
+            {
+                placeWorkerThread( placement, worker );
+
+                g->run();
+            } ) );
+        }
+    }
+
+    // Samples the workers, every MONITOR_PERIOD_MS until isFinished()
+    void monitor()
+    {
+        updateProgress();
+    }
+
+    bool isFinished() const
+    {
+        return allWorkersFinished();
+    }
+
+    // Our part of the status line.  Clears progressDue_.
+    string takeProgress( bool &due )
+    {
+        due = progressDue_;
+        progressDue_ = false;
+
+        return progress_;
+    }
+
+    double getMBPS() const
+    {
+        return throughputMeter_.getMBPS();
+    }
+
+    int64_t getCompletedIOs() const
+    {
+        return completedIOs_;
+    }
+
+    int64_t getCompletedBytes() const
+    {
+        return completedBytes_;
+    }
+
+    int64_t getNumThreads() const
+    {
+        return NUM_THREADS;
+    }
+
+    string getBackendName() const
+    {
+        return generators_[0]->getBackendName();
+    }
+
+    int64_t getIOStartTime() const
+    {
+        int64_t start = numeric_limits<int64_t>::max();
+
+        for( auto &g: generators_ )
+        {
+            start = min( start, g->getIOStartTime() );
+        }
+
+        return start;
+    }
+
+    int64_t getIOEndTime() const
+    {
+        int64_t end = 0;
+
+        for( auto &g: generators_ )
+        {
+            end = max( end, g->getIOEndTime() );
+        }
+
+        return end;
+    }
+
+    // Waits for the workers and takes a last sample
+    void finish()
+    {
+        for( auto &t: threads_ )
+        {
+            t.join();
+        }
+
+        updateProgress();
+
+        if( !params.timeSeriesFile.empty() )
+        {
+            // Whatever the last full interval left over
+            if( qpc() > lastSampleTime_ ) recordTimeSeriesSample( qpc() );
+
+            writeTimeSeries();
+        }
+
+        doFinalSanityChecks();
+    }
+
+    // With several targets, each target's results follow its name.
+    // Returns how many sectors failed verification.
+    int64_t printResults() const
+    {
+        bool multiTarget = ( params.targets.size() > 1 );
+
+        if( multiTarget )
+        {
+            cout << "target " << TARGET.name << endl;
+        }
+
+        // N.B. PreconditionParser expects the steady-state line first
+        if( params.runUntilSteadyState )
+        {
+            cout << getSteadyStateReasonString() << endl;
+        }
+
+        // CPU time is only counted for the whole process
+        if( !multiTarget )
+        {
+            cout << getBackendCostString() << endl;
+        }
+
+        if( generators_[0]->getMaxReapBatch() > 1 )
+        {
+            cout << getReapBatchString() << endl;
+        }
+
+        cout << getGeometryString() << endl;
+
+        cout << getPlacementString() << endl;
+
+        cout << getBufferString() << endl;
+
+        if( isRateLimited() )
+        {
+            cout << getRateString() << endl;
+        }
+
+        if( !params.traceFile.empty() )
+        {
+            cout << getReplayString() << endl;
+        }
+
+        if( params.sharedStream )
+        {
+            cout << getSharedStreamString() << endl;
+        }
+
+        if( NUM_STREAMS > 0 )
+        {
+            cout << getStreamsString();
+        }
+
+        if( params.compressibility > 0 )
+        {
+            cout << getCompressibilityString() << endl;
+        }
+
+        if( params.uniquePayloads )
+        {
+            cout << getPayloadCostString() << endl;
+        }
+
+        if( params.discardPercentage > 0 )
+        {
+            cout << getDiscardString() << endl;
+        }
+
+        if( params.polled )
+        {
+            cout << getPollingString() << endl;
+        }
+
+        int64_t verifyMismatches = 0;
+
+        if( params.verify )
+        {
+            verifyMismatches = printVerifySummary();
+        }
+
+        printLatencySummary();
+
+        return verifyMismatches;
+    }
+
+    private:
+
+    void doFinalSanityChecks() const
+    {
+        if( !params.runUntilSteadyState && params.traceFile.empty() )
+        {
+            assert( !fixedBlockSize() || 
+                ( completedIOs_ == TOTAL_BLOCKS * numPasses_ ) );
+            assert( completedBytes_ + completedDiscardBytes_ == 
+                targetSize_ * numPasses_ );
+        }
+    }
+
+    bool allWorkersFinished() const
+    {
+        for( auto &s: workerStats_ )
+        {
+            if( !s.finished.load( memory_order_acquire ) ) return false;
+        }
+
+        return true;
+    }
+
+    void updateProgress()
+    {
+        int64_t ios = 0;
+        int64_t bytes = 0;
+        int64_t discardBytes = 0;
+
+        for( auto &s: workerStats_ )
+        {
+            ios += s.completedIOs.load( memory_order_relaxed );
+            bytes += s.completedBytes.load( memory_order_relaxed );
+            discardBytes += s.discardBytes.load( memory_order_relaxed );
+        }
+
+        int64_t newIOs = ios - completedIOs_;
+        int64_t newBytes = bytes - completedBytes_;
+
+        completedIOs_ = ios;
+        completedBytes_ = bytes;
+        completedDiscardBytes_ = discardBytes;
+
+        throughputMeter_.trackCompletions( newIOs, newBytes );
+
+        if( !params.timeSeriesFile.empty() )
+        {
+            int64_t now = qpc();
+
+            if( now - lastSampleTime_ >= SAMPLE_TICKS )
+            {
+                recordTimeSeriesSample( now );
+            }
+        }
+
+        if( params.runUntilSteadyState )
+        {
+            handleCompletionSteadyState(
+                ( params.steadyStateMetric == IOS_METRIC ) ? 
+                    newIOs : newBytes );
+        }
+        else
+        {
+            handleCompletionTotalIOs();
+        }
+    }
+
+    void recordTimeSeriesSample( int64_t now )
+    {
+        TimeSeriesSample sample;
+
+        sample.startNanoseconds = 
+            ticksToNanoseconds( lastSampleTime_ - seriesStart_ );
+        sample.durationNanoseconds = 
+            ticksToNanoseconds( now - lastSampleTime_ );
+
+        int64_t readBytes = 0;
+        int64_t writeBytes = 0;
+
+        for( auto &s: workerStats_ )
+        {
+            readBytes += s.readBytes.load( memory_order_relaxed );
+            writeBytes += s.writeBytes.load( memory_order_relaxed );
+        }
+
+        sample.readBytes = readBytes - seriesReadBytes_;
+        sample.writeBytes = writeBytes - seriesWriteBytes_;
+
+        seriesReadBytes_ = readBytes;
+        seriesWriteBytes_ = writeBytes;
+
+        // The histograms count IOs too, and agree with the heatmap
+        sample.readIOs = addIntervalLatencies( 
+            false, seriesReadLatency_, sample );
+        sample.writeIOs = addIntervalLatencies( 
+            true, seriesWriteLatency_, sample );
+
+        timeSeries_.add( sample );
+
+        lastSampleTime_ = now;
+    }
+
+    // Adds one direction's latencies since the last sample to it, and
+    // returns how many there were.  Borrows the latency window scratch.
+    int64_t addIntervalLatencies(
+            bool writes,
+            LatencyHistogram &snapshot,
+            TimeSeriesSample &sample )
+    {
+        latencyCurrent_.reset();
+
+        for( auto &g: generators_ )
+        {
+            latencyCurrent_.merge( 
+                writes ? g->getWriteLatency() : g->getReadLatency() );
+        }
+
+        latencyWindow_.reset();
+        latencyWindow_.merge( latencyCurrent_ );
+        latencyWindow_.subtract( snapshot );
+
+        sample.addLatencies( latencyWindow_ );
+
+        snapshot.reset();
+        snapshot.merge( latencyCurrent_ );
+
+        return latencyWindow_.getCount();
+    }
+
+    void writeTimeSeries()
+    {
+        timeSeries_.finish();
+
+        string file = params.timeSeriesFile;
+
+        if( params.targets.size() > 1 )
+        {
+            file += "." + to_string( TARGET_INDEX );
+        }
+
+        string csvFile = file + ".csv";
+
+        ofstream binary( file, ios::binary );
+        ofstream csv( csvFile );
+
+        timeSeries_.writeBinary( binary );
+        timeSeries_.writeCsv( csv );
+
+        if( !binary || !csv )
+        {
+            cerr << "Error: couldn't write time series to " 
+                << file << " and " << csvFile << endl;
+
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    void printLatencySummary() const
+    {
+        LatencyHistogram readLatency;
+        LatencyHistogram writeLatency;
+        LatencyHistogram discardLatency;
+
+        for( auto &g: generators_ )
+        {
+            readLatency.merge( g->getReadLatency() );
+            writeLatency.merge( g->getWriteLatency() );
+            discardLatency.merge( g->getDiscardLatency() );
+        }
+
+        if( readLatency.getCount() > 0 )
+        {
+            cout << "read latency (us): " 
+                << readLatency.getSummary() << endl;
+        }
+
+        if( writeLatency.getCount() > 0 )
+        {
+            cout << "write latency (us): " 
+                << writeLatency.getSummary() << endl;
+        }
+
+        if( discardLatency.getCount() > 0 )
+        {
+            cout << "discard latency (us): " 
+                << discardLatency.getSummary() << endl;
+        }
+
+        LatencyHistogram replayLag;
+
+        for( auto &g: generators_ )
+        {
+            replayLag.merge( g->getReplayLag() );
+        }
+
+        // How late each IO was issued, relative to the trace
+        if( replayLag.getCount() > 0 )
+        {
+            cout << "replay lag (us): " 
+                << replayLag.getSummary() << endl;
+        }
+    }
+
+    // e.g. "completions polled by io_uring IOPOLL: p50 11.2 us vs 16.9 us
+    // interrupt-driven, saving 5.7 us per IO (mean 6.0 us), 1234 IOs
+    // sampled"
+    string getPollingString() const
+    {
+        LatencyHistogram polled;
+        LatencyHistogram interrupted;
+
+        for( auto &g: generators_ )
+        {
+            polled.merge( g->getPolledLatency() );
+            interrupted.merge( g->getInterruptLatency() );
+        }
+
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 1 );
+
+        msg << "completions polled by " << generators_[0]->getPollingMode();
+
+        if( interrupted.getCount() == 0 )
+        {
+            msg << ", run too short to sample interrupt-driven IOs";
+
+            return msg.str();
+        }
+
+        double polledP50 = polled.getPercentile( 50 ) / 1000.0;
+        double interruptedP50 = interrupted.getPercentile( 50 ) / 1000.0;
+
+        msg << ": p50 " << polledP50 << " us vs " << interruptedP50 
+            << " us interrupt-driven, saving " 
+            << interruptedP50 - polledP50 << " us per IO (mean " 
+            << ( interrupted.getMean() - polled.getMean() ) / 1000.0 
+            << " us), " << interrupted.getCount() << " IOs sampled";
+
+        return msg.str();
+    }
+
+    string getDiscardString() const
+    {
+        int64_t discards = 0;
+        int64_t bytes = 0;
+
+        for( auto &g: generators_ )
+        {
+            discards += g->getCompletedDiscards();
+            bytes += g->getCompletedDiscardBytes();
+        }
+
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 2 );
+
+        msg << "discarded " << bytes / 1024.0 / 1024.0 / 1024.0 
+            << " GB in " << discards << " IOs";
+
+        return msg.str();
+    }
+
+    // Lets us compare what each backend costs for the same workload
+    string getBackendCostString() const
+    {
+        return describeBackendCost( 
+            getBackendName(), 
+            cpuSecondsUsed() - cpuStart_, 
+            completedIOs_, 
+            NUM_THREADS );
+    }
+
+    // e.g. "completions reaped 6.2 per wait, in batches of up to 8"
+    string getReapBatchString() const
+    {
+        int64_t reapCalls = 0;
+
+        for( auto &g: generators_ )
+        {
+            reapCalls += g->getReapCalls();
+        }
+
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 1 );
+
+        msg << "completions reaped " 
+            << ( ( reapCalls > 0 ) ? 
+                static_cast<double>( completedIOs_ ) / reapCalls : 0 )
+            << " per wait, in batches of up to " 
+            << generators_[0]->getMaxReapBatch();
+
+        return msg.str();
+    }
+
+    string getGeometryString() const
+    {
+        ostringstream msg;
+
+        msg << "target sectors " << GEOMETRY.logicalSectorSize 
+            << " B logical, " << GEOMETRY.physicalSectorSize 
+            << " B physical";
+
+        if( GEOMETRY.optimalIOSize > 0 )
+        {
+            msg << ", optimal IO " << GEOMETRY.optimalIOSize << " B";
+        }
+
+        return msg.str();
+    }
+
+    string getBufferString() const
+    {
+        bool registered = true;
+
+        for( auto &g: generators_ )
+        {
+            registered = registered && g->getBuffersRegistered();
+        }
+
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 1 );
+
+        double kilobytes = bufferPool.getSize() / 1024.0;
+
+        msg << "io buffers ";
+
+        if( kilobytes < 1024 )
+        {
+            msg << kilobytes << " KB";
+        }
+        else
+        {
+            msg << kilobytes / 1024 << " MB";
+        }
+
+        msg << " in " << bufferPool.getPageKindName()
+            << ( bufferPool.isLocked() ? ", locked" : ", unlocked" )
+            << ( registered ? ", registered with the backend" : "" );
+
+        return msg.str();
+    }
+
+    string getPlacementString() const
+    {
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 1 );
+
+        msg << "placement ";
+
+        if( PLACEMENT.node == NO_NODE )
+        {
+            msg << "none (" << PLACEMENT.reason << ")";
+        }
+        else
+        {
+            msg << "node " << PLACEMENT.node << ", cpus ";
+
+            for( int64_t i = 0; i < NUM_THREADS; ++i )
+            {
+                msg << ( i > 0 ? "," : "" ) 
+                    << PLACEMENT.cpus[FIRST_WORKER + i];
+            }
+
+            if( PLACEMENT.buffersBound )
+            {
+                msg << ", buffers on node " << PLACEMENT.node << " (" 
+                    << PLACEMENT.nodeFreeBytes / 1024.0 / 1024.0 / 1024.0
+                    << " GB free)";
+            }
+            else
+            {
+                msg << ", buffers unbound";
+            }
+        }
+
+        if( params.realTime ) msg << ", real-time";
+
+        return msg.str();
+    }
+
+    int64_t printVerifySummary() const
+    {
+        int64_t sectors = 0;
+        int64_t mismatches = 0;
+
+        for( auto &g: generators_ )
+        {
+            sectors += g->getVerifiedSectors();
+            mismatches += g->getVerifyMismatches();
+        }
+
+        cout << "verify (crc32c " << getCrc32cKernelName() << "): "
+            << sectors << " sectors checked, " 
+            << mismatches << " mismatches" << endl;
+
+        return mismatches;
+    }
+
+    // Confirms the generator isn't what we're measuring
+    string getPayloadCostString() const
+    {
+        int64_t ticks = 0;
+        int64_t bytes = 0;
+
+        for( auto &g: generators_ )
+        {
+            ticks += g->getPayloadTicks();
+            bytes += g->getPayloadBytes();
+        }
+
+        double cpuSeconds = static_cast<double>( ticks ) / QPC_TICKS_PER_SEC;
+        double gigabytes = static_cast<double>( bytes ) / 1e9;
+
+        double cpuMillisecondsPerGB = ( gigabytes > 0 ) ?
+            cpuSeconds * 1e3 / gigabytes : 0;
+
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 2 );
+
+        msg << "unique payloads (" << getUniquePayloadKernelName()
+            << ") used " << cpuSeconds << " CPU seconds, "
+            << cpuMillisecondsPerGB << " ms per GB";
+
+        return msg.str();
+    }
+
+    // Over the whole run: did we actually hold the requested rate?
+    string getRateString() const
+    {
+        double seconds = getIOSeconds();
+
+        double iops = ( seconds > 0 ) ? completedIOs_ / seconds : 0;
+        double mbps = ( seconds > 0 ) ? 
+            completedBytes_ / 1024.0 / 1024.0 / seconds : 0;
+
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 1 );
+
+        msg << "rate limit";
+
+        if( params.targetIOPS > 0 ) msg << " " << params.targetIOPS << " IOPS";
+        if( params.targetIOPS > 0 && params.targetMBps > 0 ) msg << " and";
+        if( params.targetMBps > 0 ) msg << " " << params.targetMBps << " MB/s";
+
+        msg << ", achieved " << iops << " IOPS, " << mbps << " MB/s";
+
+        return msg.str();
+    }
+
+    // From the first worker starting its IOs to the last finishing them
+    double getIOSeconds() const
+    {
+        return static_cast<double>( getIOEndTime() - getIOStartTime() ) / 
+            QPC_TICKS_PER_SEC;
+    }
+
+    // Stream j's region starts here.  Spread like the workers' slices,
+    // so regions differ by one block at most.
+    int64_t getStreamFirstBlock( int64_t j ) const
+    {
+        return TOTAL_BLOCKS * j / NUM_STREAMS;
+    }
+
+    // One line for the whole, then one per stream, e.g.
+    //   "stream 3 at 96.00 GB: 512.3 MB/s"
+    string getStreamsString() const
+    {
+        double seconds = getIOSeconds();
+
+        double mbps = ( seconds > 0 ) ? 
+            completedBytes_ / 1024.0 / 1024.0 / seconds : 0;
+
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 1 );
+
+        msg << NUM_STREAMS << " sequential streams on " << NUM_THREADS 
+            << " threads, " << mbps << " MB/s in total" << endl;
+
+        int64_t j = 0;
+
+        for( auto &g: generators_ )
+        {
+            for( auto &stream: g->getStreamStats() )
+            {
+                double startGB = static_cast<double>( 
+                    getStreamFirstBlock( j ) * params.blockSize ) / 
+                    1024 / 1024 / 1024;
+
+                msg << "stream " << j << " at " 
+                    << setprecision( 2 ) << startGB << " GB: "
+                    << setprecision( 1 ) << stream.getMBps() << " MB/s" 
+                    << endl;
+
+                j++;
+            }
+        }
+
+        assert( j == NUM_STREAMS );
+
+        return msg.str();
+    }
+
+    // A whole number of the largest IO, so every claim starts aligned
+    static int64_t getSharedClaimBytes()
+    {
+        return divRoundUp( SHARED_CLAIM_BYTES, params.blockSize ) * 
+            params.blockSize;
+    }
+
+    string getSharedStreamString() const
+    {
+        double seconds = getIOSeconds();
+
+        double mbps = ( seconds > 0 ) ? 
+            completedBytes_ / 1024.0 / 1024.0 / seconds : 0;
+
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 1 );
+
+        msg << "shared sequential stream across " << NUM_THREADS 
+            << " threads, " << getSharedClaimBytes() / 1024 
+            << " KB claims, " << mbps << " MB/s";
+
+        return msg.str();
+    }
+
+    // Did we keep up with the trace's clock, and if not, by how much?
+    string getReplayString() const
+    {
+        int64_t end = 0;
+        double traceSeconds = 0;
+
+        for( auto &g: generators_ )
+        {
+            end = max( end, g->getIOEndTime() );
+            traceSeconds = max( traceSeconds, g->getLastRecordSeconds() );
+        }
+
+        double seconds = 
+            static_cast<double>( end - seriesStart_ ) / QPC_TICKS_PER_SEC;
+
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 2 );
+
+        if( params.replaySpeed > 0 )
+        {
+            double scheduled = traceSeconds / params.replaySpeed;
+
+            msg << "trace replay at " << params.replaySpeed << "x: "
+                << completedIOs_ << " IOs, " << scheduled << " s scheduled, "
+                << seconds << " s taken, " << ( seconds - scheduled ) 
+                << " s drift";
+        }
+        else
+        {
+            double iops = ( seconds > 0 ) ? completedIOs_ / seconds : 0;
+
+            msg << "trace replay as fast as possible: "
+                << completedIOs_ << " IOs in " << seconds << " s, " 
+                << iops << " IOPS";
+        }
+
+        return msg.str();
+    }
+
+    string getCompressibilityString() const
+    {
+        ostringstream msg;
+
+        msg.setf( std::ios::fixed );
+        msg.precision( 1 );
+
+        msg << "write data " << params.compressibility 
+            << "% compressible, measured " << measuredCompressibility_ 
+            << "%";
+
+        return msg.str();
     }
 
     void handleCompletionTotalIOs()
     {
-        double percentCompleted = 
-            ( static_cast<double>( completedBytes_ ) /
-            ( targetSize_ * numPasses_ ) ) * 100;
+        double percentCompleted = params.traceFile.empty() ?
+            ( static_cast<double>( completedBytes_ + completedDiscardBytes_ ) /
+            ( targetSize_ * numPasses_ ) ) * 100 :
+            getTracePercentRead();
 
         ostringstream msg;
-        
+
         msg.setf( std::ios::fixed );
         msg.precision( 1 );
 
-        msg << params.progressPrefix.c_str()
-            << percentCompleted << "%";
+        msg << percentCompleted << "%";
 
         msg << " [" << throughputMeter_.getMBPS() << " MB/s]";
 
+        if( ( percentCompleted == 100 ) && params.verify )
+        {
+            msg << ", verifying";
+        }
+
         // Ensure we print a message for 100% to avoid
         // the appearance of having stopped prematurely
-        if( percentCompleted == 100 )
+        if( ( percentCompleted == 100 ) && !reportedComplete_ )
         {
-            statusLine_.forceWrite( msg.str() );
+            progressDue_ = true;
+
+            reportedComplete_ = true;
         }
-        else
+
+        progress_ = msg.str();
+    }
+
+    double getTracePercentRead() const
+    {
+        int64_t bytes = 0;
+
+        for( auto &s: workerStats_ )
         {
-            statusLine_.writeMaybe( msg.str() );
+            bytes += s.traceBytes.load( memory_order_relaxed );
         }
+
+        return static_cast<double>( bytes ) / trace_.getSize() * 100;
     }
 
     string getSteadyStateReasonString() const
     {
         assert( steadyStateAchieved_ || steadyStateAssumedIOs_ );
-        
+
         ostringstream msg;
-        
+
         int secondsElapsed = secondsSince( qpcStart_ );
-        
+
         if( steadyStateAchieved_ )
         {
+            // PreconditionParser reports the criterion in parentheses
             msg << "achieved steady-state after "
-                << secondsElapsed << " seconds";
+                << secondsElapsed << " seconds ("
+                << steadyStateDetector_.getCriterion() << ")";
         }
         else if( steadyStateAssumedIOs_ )
         {
@@ -709,20 +3725,46 @@ class IOGenerator
         return msg.str();
     }
 
-    void handleCompletionSteadyState()
+    // Hands the detector the latency distribution of every IO completed,
+    // by any worker, since the previous window
+    void trackLatencyWindow()
+    {
+        latencyCurrent_.reset();
+
+        for( auto &g: generators_ )
+        {
+            latencyCurrent_.merge( g->getReadLatency() );
+            latencyCurrent_.merge( g->getWriteLatency() );
+        }
+
+        latencyWindow_.reset();
+        latencyWindow_.merge( latencyCurrent_ );
+        latencyWindow_.subtract( latencySnapshot_ );
+
+        steadyStateDetector_.trackLatencyWindow( latencyWindow_ );
+
+        latencySnapshot_.reset();
+        latencySnapshot_.merge( latencyCurrent_ );
+    }
+
+    void handleCompletionSteadyState( int64_t newCompletions )
     {
-        steadyStateDetector_.trackCompletion();
-        
-        double hoursElapsed = secondsSince( qpcStart_ ) / 3600;
-        
+        // Workers have been told to stop, and are just draining
+        if( steadyStateAchieved_ || steadyStateAssumedIOs_ ) return;
+
+        steadyStateDetector_.trackCompletions( newCompletions );
+
+        if( steadyStateDetector_.latencyWindowDue() )
+        {
+            trackLatencyWindow();
+        }
+
         bool done = false;
-        
+
         ostringstream msg;
-            
+
         msg.setf( std::ios::fixed );
         msg.precision( 1 );
-        
-        msg << params.progressPrefix.c_str();
 
         // Some drives have such erratic performance that
         // they may never meet our definiton of steady-state.
@@ -740,117 +3782,275 @@ class IOGenerator
 
         if( done )
         {
+            stopRequested_.store( true, memory_order_relaxed );
+
             msg << getSteadyStateReasonString();
 
-            statusLine_.forceWrite( msg.str() );
+            progressDue_ = true;
         }
         else
         {
             msg << steadyStateDetector_.getProgressMessage()
                 << " [" << throughputMeter_.getMBPS() << " MB/s]";
-
-            statusLine_.writeMaybe( msg.str() );
         }
+
+        progress_ = msg.str();
     }
+};
 
-    void handleCompletion( int64_t bytes, OVERLAPPED *op )
-    {
-        // First priority: post the next IO
-        // Second priority: track stats for the just-completed IO
-        //
-        // The idea is to come as close as possible to attaining
-        // the requested queue depth.
-        
-        inFlight_--;
+// Our part of the status line, then each target's in turn, e.g.
+// "0: 45.0% [812.3 MB/s], 1: 47.1% [790.0 MB/s] [1602.3 MB/s in total]"
+void writeStatusLine( 
+        StatusLine &statusLine, 
+        vector< unique_ptr<IOEngine> > &engines )
+{
+    bool multiTarget = ( engines.size() > 1 );
+    bool due = false;
+    double mbps = 0;
 
-        completedIOs_++;
-        completedBytes_ += bytes;
+    ostringstream msg;
 
-        if( shouldPostAnotherIO() )
-        {
-            // Convert overlapped pointer to index
-            int64_t idx = op - &overlapped_[0];
+    msg.setf( std::ios::fixed );
+    msg.precision( 1 );
 
-            postNextIO( idx );
-        }
+    msg << params.progressPrefix.c_str();
 
-        throughputMeter_.trackCompletion( bytes );
+    for( size_t i = 0; i < engines.size(); ++i )
+    {
+        bool engineDue = false;
 
-        if( params.runUntilSteadyState )
+        string progress = engines[i]->takeProgress( engineDue );
+
+        if( multiTarget )
         {
-            handleCompletionSteadyState();
+            msg << ( i > 0 ? ", " : "" ) << i << ": ";
         }
-        else
+
+        msg << progress;
+
+        due = due || engineDue;
+        mbps += engines[i]->getMBPS();
+    }
+
+    if( multiTarget )
+    {
+        msg << " [" << mbps << " MB/s in total]";
+    }
+
+    // Don't sit on 100% or steady-state, or we seem to have stopped
+    if( due )
+    {
+        statusLine.forceWrite( msg.str() );
+    }
+    else
+    {
+        statusLine.writeMaybe( msg.str() );
+    }
+}
+
+// With several targets, what they did together.  Every slot busy at
+// once is how a host, HBA, or PCIe bottleneck shows itself.
+void printTotals( 
+        const vector< unique_ptr<IOEngine> > &engines, 
+        double cpuSeconds )
+{
+    int64_t start = numeric_limits<int64_t>::max();
+    int64_t end = 0;
+    int64_t ios = 0;
+    int64_t bytes = 0;
+    int64_t numThreads = 0;
+
+    for( auto &e: engines )
+    {
+        start = min( start, e->getIOStartTime() );
+        end = max( end, e->getIOEndTime() );
+        ios += e->getCompletedIOs();
+        bytes += e->getCompletedBytes();
+        numThreads += e->getNumThreads();
+    }
+
+    double seconds = static_cast<double>( end - start ) / QPC_TICKS_PER_SEC;
+
+    double iops = ( seconds > 0 ) ? ios / seconds : 0;
+    double mbps = ( seconds > 0 ) ? bytes / 1024.0 / 1024.0 / seconds : 0;
+
+    ostringstream msg;
+
+    msg.setf( std::ios::fixed );
+    msg.precision( 1 );
+
+    msg << "all " << engines.size() << " targets: " 
+        << mbps << " MB/s, " << iops << " IOPS";
+
+    cout << msg.str() << endl;
+
+    cout << describeBackendCost( 
+        engines[0]->getBackendName(), cpuSeconds, ios, numThreads ) << endl;
+}
+
+// Drives every target's engine at once, from this thread
+void runEngines( vector< unique_ptr<IOEngine> > &engines )
+{
+    StatusLine statusLine;
+
+    double cpuStart = cpuSecondsUsed();
+
+    for( auto &e: engines )
+    {
+        e->start();
+    }
+
+    bool finished = false;
+
+    while( !finished )
+    {
+        this_thread::sleep_for(
+            chrono::milliseconds( IOEngine::MONITOR_PERIOD_MS ) );
+
+        finished = true;
+
+        for( auto &e: engines )
         {
-            handleCompletionTotalIOs();
+            // Sampled even once finished, so they can report 100%
+            e->monitor();
+
+            finished = finished && e->isFinished();
         }
+
+        writeStatusLine( statusLine, engines );
     }
-};
-    
-void CALLBACK ioCompletionRoutine(
-        DWORD error,
-        DWORD bytes,
-        LPOVERLAPPED overlapped )
-{
-    assert( overlapped != NULL );
 
-    if( error )
+    for( auto &e: engines )
     {
-        cerr
-            << endl << "IO failed to complete. Error: " 
-            << error << endl;
+        e->finish();
+    }
 
-        exit( EXIT_FAILURE );
+    writeStatusLine( statusLine, engines );
+
+    cerr << endl;
+
+    int64_t verifyMismatches = 0;
+
+    for( auto &e: engines )
+    {
+        verifyMismatches += e->printResults();
     }
-   
-    // Coerce our secret pointer back to its proper type.
-    IOGenerator *ioGen = 
-        reinterpret_cast<IOGenerator*>( overlapped->hEvent );
 
-    assert( ioGen != NULL );
-   
-    ioGen->handleCompletion( bytes, overlapped );
+    if( engines.size() > 1 )
+    {
+        printTotals( engines, cpuSecondsUsed() - cpuStart );
+    }
+
+    if( verifyMismatches > 0 )
+    {
+        cerr << "Error: target failed verification" << endl;
+        exit( EXIT_FAILURE );
+    }
 }
 
 int main( int argc, char *argv[] )
 {
     parseCmdline( argc, argv );
 
-    if( params.writePercentage > 0 && params.shouldPrompt )
+    // A trace may write whatever -w says
+    if( ( params.writePercentage > 0 || !params.traceFile.empty() ) && 
+            params.shouldPrompt )
     {
         continuePrompt();
     }
 
-    HANDLE targetHandle = checkedOpenTarget( params.testFileName );
-    
-    const int64_t originalTargetSize = params.rawDisk ?
-        checkedGetDiskLength( targetHandle ) :
-        checkedGetFileSizeEx( targetHandle );
-  
-    int64_t targetSize = originalTargetSize;
+    // Only used to size the targets.  Each worker opens its own.
+    vector< unique_ptr<IOBackend> > backends;
+    vector< int64_t > originalTargetSizes;
+    vector< int64_t > targetSizes;
+    vector< TargetGeometry > geometries;
+
+    for( auto &target: params.targets )
+    {
+        unique_ptr<IOBackend> backend =
+            createIOBackend( params.ioBackend, 1 );
+
+        backend->openTarget( target.name, target.rawDisk );
+
+        const int64_t originalTargetSize = backend->getTargetSize();
+
+        int64_t targetSize = originalTargetSize;
+
+        const TargetGeometry geometry = backend->getTargetGeometry();
+
+        checkTargetGeometry( geometry );
+
+        // So the last IO is as natively aligned as the rest
+        const int64_t sectorSize = geometry.physicalSectorSize;
+
+        if( targetSize % sectorSize != 0 )
+        {
+            cerr << "Warning: " << target.name 
+                << " is not an even multiple of " << sectorSize << " B" 
+                << endl;
+
+            cerr << "Target will not be completely overwritten" << endl;
+
+            targetSize =
+                (targetSize / sectorSize ) * sectorSize ;
+        }
+
+        backends.push_back( move( backend ) );
+        originalTargetSizes.push_back( originalTargetSize );
+        targetSizes.push_back( targetSize );
+        geometries.push_back( geometry );
+    }
+
+    // Replayed IOs may be any size we support
+    bufferPool.allocate( 
+        params.traceFile.empty() ? params.blockSize : MAX_IO_SIZE,
+        params.outstandingIOs * params.targets.size() );
+
+    Placement placement = planPlacement( 
+        params.numThreads * params.targets.size() );
 
-    if( targetSize % SECTOR_SIZE != 0 )
+    placeBuffers( placement );
+
+    // Before any worker exists, so they all inherit it
+    if( params.realTime && !setRealTimePriority() )
     {
-        cerr << "Warning: target is not an even multiple of "
-            << SECTOR_SIZE << " B" << endl;
-        
-        cerr << "Target will not be completely overwritten" << endl;
+        cerr << "Error: couldn't get real-time priority (needs "
+#ifdef _WIN32
+            << "an administrator"
+#else
+            << "CAP_SYS_NICE"
+#endif
+            << ")\n";
+        exit( EXIT_FAILURE );
+    }
 
-        targetSize = 
-            (targetSize / SECTOR_SIZE ) * SECTOR_SIZE ;
+    vector< unique_ptr<IOEngine> > engines;
+
+    for( size_t i = 0; i < params.targets.size(); ++i )
+    {
+        engines.push_back( unique_ptr<IOEngine>( new IOEngine( 
+            params.targets[i],
+            i,
+            targetSizes[i], 
+            geometries[i], 
+            placement, 
+            params.numPasses, 
+            params.numThreads ) ) );
     }
 
     // Do all the IOs
-    IOGenerator( targetHandle, targetSize, params.numPasses ).run();
+    runEngines( engines );
 
-    // We should never extend the target size
-    const int64_t finalTargetSize = params.rawDisk ?
-        checkedGetDiskLength( targetHandle ) :
-        checkedGetFileSizeEx( targetHandle );
+    for( size_t i = 0; i < backends.size(); ++i )
+    {
+        // We should never extend the target size
+        const int64_t finalTargetSize = backends[i]->getTargetSize();
 
-    assert( finalTargetSize == originalTargetSize );
+        assert( finalTargetSize == originalTargetSizes[i] );
+        ( void ) finalTargetSize; // Only checked in debug builds
 
-    CloseHandle( targetHandle );
+        backends[i]->closeTarget();
+    }
 
     exit( EXIT_SUCCESS );
 }
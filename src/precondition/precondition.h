@@ -36,28 +36,103 @@
 #include <algorithm>
 #include <regex>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <sstream>
+#include <fstream>
+#include <tuple>
+#include <cmath>
+#include <numeric>
 
 #include <cstdlib>
+#include <cstddef>
 #include <cctype>
 #include <cstdint>
 #include <cstdio>
 #include <cassert>
 
+#ifdef _WIN32
 #define NOMINMAX
 #include <windows.h>
 #include <conio.h>
-
-// ISSUE-REVIEW: can we actually sustain QD this high without multithreading?
+#else
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <linux/falloc.h>
+#endif
+
+// Total across all worker threads; use -T if one thread can't keep up
 const int MAX_OUTSTANDING_IOS = 256; // queue depth
 
 const int MAX_IO_SIZE = 2 * 1024 * 1024; // 2MB
-#define SECTOR_SIZE 512 // FIXME: This should be dynamic
 
-enum AccessPattern { SEQUENTIAL, RANDOM };
+// With -si, workers take this much of the shared stream at a time, or
+// one IO if that's larger.  Small enough that the claims in flight stay
+// close together, large enough that 4K IOs rarely touch the cursor.
+const int SHARED_CLAIM_BYTES = 256 * 1024;
+
+// The smallest sector any target has.  Verify stamps and unique payloads
+// are laid out in these, since every real sector is a multiple of it.
+// IOs follow the target's own TargetGeometry.
+#define SECTOR_SIZE 512
+
+// BufferPool aligns its buffers for logical sectors up to this size
+const int MAX_SECTOR_SIZE = 4096;
+
+// What the target says about its sectors
+struct TargetGeometry
+{
+    int64_t logicalSectorSize; // The smallest IO it accepts at all
+    int64_t physicalSectorSize; // The smallest it doesn't read-modify-write
+    int64_t optimalIOSize; // 0 if it doesn't say
+
+    TargetGeometry()
+        : logicalSectorSize( SECTOR_SIZE )
+        , physicalSectorSize( SECTOR_SIZE )
+        , optimalIOSize( 0 )
+    {}
+};
+
+enum AccessPattern
+{
+    SEQUENTIAL, RANDOM, REVERSE, STRIDE, ZIPF, HOT_COLD, GAUSSIAN
+};
 
 std::string accessPatternToString( const AccessPattern& ap )
 {
-    return ( ap == SEQUENTIAL ) ? "sequential" : "random";
+    switch( ap )
+    {
+        case RANDOM: return "random";
+        case REVERSE: return "reverse";
+        case STRIDE: return "stride";
+        case ZIPF: return "zipf";
+        case HOT_COLD: return "hotcold";
+        case GAUSSIAN: return "gaussian";
+        default: return "sequential";
+    }
+}
+
+// What SteadyStateDetector bins.  LATENCY_METRIC bins bytes, and also
+// requires the latency distribution to stop moving.
+enum SteadyStateMetric { IOS_METRIC, BYTES_METRIC, LATENCY_METRIC };
+
+std::string steadyStateMetricToString( const SteadyStateMetric& m )
+{
+    switch( m )
+    {
+        case BYTES_METRIC: return "bytes";
+        case LATENCY_METRIC: return "latency";
+        default: return "ios";
+    }
 }
 
 const int DEFAULT_IO_SIZE = 1024 * 1024; // 1MB
@@ -65,18 +140,22 @@ const AccessPattern DEFAULT_ACCESS_PATTERN = SEQUENTIAL;
 const int DEFAULT_OUTSTANDING_IOS = MAX_OUTSTANDING_IOS;
 const int DEFAULT_WRITE_PERCENTAGE = 100;
 const int DEFAULT_NUM_PASSES = 1;
-
-// 2x the MAX_IO_SIZE, to enable random offsets later on
-__declspec( align( SECTOR_SIZE ) )
-    std::array< uint8_t, MAX_IO_SIZE * 2 >
-        writeDataBuffer;
-
-typedef std::array< uint8_t, MAX_IO_SIZE > ReadDataBuffer;
-
-__declspec( align( SECTOR_SIZE ) )
-    std::array< ReadDataBuffer, MAX_OUTSTANDING_IOS >
-        readDataBuffers;
-
+const int DEFAULT_NUM_THREADS = 1;
+const int DEFAULT_COMPRESSIBILITY = 0;
+const double DEFAULT_ZIPF_THETA = 0.99;
+const double DEFAULT_HOTSPOT_SIGMA = 5; // Percent of the target
+const double DEFAULT_HOTSPOT_DRIFT = 1; // Percent of the target per second
+const int DEFAULT_TIME_SERIES_INTERVAL_MS = 100;
+const double DEFAULT_REPLAY_SPEED = 1; // Times the trace's own speed
+const SteadyStateMetric DEFAULT_STEADY_STATE_METRIC = IOS_METRIC;
+
+#ifdef _WIN32
+const char * const DEFAULT_IO_BACKEND = "win32";
+#else
+const char * const DEFAULT_IO_BACKEND = "auto";
+#endif
+
+#ifdef _WIN32
 int64_t qpf() 
 {
     LARGE_INTEGER f;
@@ -84,14 +163,60 @@ int64_t qpf()
     return f.QuadPart;
 }
 
-const int64_t QPC_TICKS_PER_SEC = qpf();
-
 int64_t qpc()
 {
     LARGE_INTEGER t;
     QueryPerformanceCounter(&t);
     return t.QuadPart;
 }
+#else
+// CLOCK_MONOTONIC stands in for QueryPerformanceCounter, in nanoseconds
+int64_t qpf()
+{
+    return 1000000000LL;
+}
+
+int64_t qpc()
+{
+    timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return static_cast<int64_t>( t.tv_sec ) * 1000000000LL + t.tv_nsec;
+}
+#endif
+
+const int64_t QPC_TICKS_PER_SEC = qpf();
+
+// User plus kernel time, summed over every thread in the process
+double cpuSecondsUsed()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+
+    GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user );
+
+    ULARGE_INTEGER k, u;
+
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+
+    // FILETIME is in 100ns units
+    return static_cast<double>( k.QuadPart + u.QuadPart ) / 1e7;
+#else
+    rusage r;
+
+    getrusage( RUSAGE_SELF, &r );
+
+    return r.ru_utime.tv_sec + r.ru_utime.tv_usec / 1e6 +
+        r.ru_stime.tv_sec + r.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+uint64_t ticksToNanoseconds( int64_t ticks )
+{
+    return static_cast<uint64_t>( ticks * ( 1e9 / QPC_TICKS_PER_SEC ) );
+}
 
 double secondsSince( int64_t start )
 {
@@ -117,6 +242,16 @@ int64_t divRoundUp( int64_t dividend, int64_t divisor )
     return (dividend + (divisor - 1)) / divisor;
 }
 
+int getKeypress()
+{
+#ifdef _WIN32
+    return _getch();
+#else
+    return getchar();
+#endif
+}
+
+#ifdef _WIN32
 HANDLE checkedCreateEvent( bool state )
 {
     using namespace std;
@@ -142,7 +277,7 @@ HANDLE checkedOpenTarget( std::string targetName )
     HANDLE h = CreateFile( 
         targetName.c_str(),
         GENERIC_READ | GENERIC_WRITE,
-        FILE_SHARE_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, // one handle per worker thread
         NULL,
         OPEN_EXISTING,
         FILE_FLAG_NO_BUFFERING |
@@ -238,6 +373,153 @@ int64_t checkedGetDiskLength( HANDLE targetHandle )
     return diskLengthInfo.Length.QuadPart;
 }
 
+// Deallocates a range: a DSM trim on a raw disk, or a file-level trim
+// on a file.  Blocks until done.  Returns 0 or GetLastError().
+DWORD discardRange(
+        HANDLE targetHandle,
+        bool rawDisk,
+        int64_t offset,
+        int64_t bytes )
+{
+    struct DiskTrim
+    {
+        DEVICE_MANAGE_DATA_SET_ATTRIBUTES attributes;
+        DEVICE_DATA_SET_RANGE range;
+    };
+
+    DiskTrim diskTrim = {0};
+    FILE_LEVEL_TRIM fileTrim = {0};
+    OVERLAPPED overlapped = {0};
+    DWORD bytesReturned = 0;
+
+    HANDLE event = checkedCreateEvent( false );
+
+    overlapped.hEvent = event;
+
+    bool retVal;
+
+    if( rawDisk )
+    {
+        // There is no file system on a disk we precondition
+        diskTrim.attributes.Size = sizeof( diskTrim.attributes );
+        diskTrim.attributes.Action = DeviceDsmAction_Trim;
+        diskTrim.attributes.Flags = DEVICE_DSM_FLAG_TRIM_NOT_FS_ALLOCATED;
+        diskTrim.attributes.DataSetRangesOffset = 
+            offsetof( DiskTrim, range );
+        diskTrim.attributes.DataSetRangesLength = sizeof( diskTrim.range );
+        diskTrim.range.StartingOffset = offset;
+        diskTrim.range.LengthInBytes = bytes;
+
+        retVal = DeviceIoControl(
+                targetHandle,
+                IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES,
+                &diskTrim,
+                sizeof( diskTrim ),
+                NULL,
+                0,
+                &bytesReturned,
+                &overlapped );
+    }
+    else
+    {
+        fileTrim.NumRanges = 1;
+        fileTrim.Ranges[0].Offset = offset;
+        fileTrim.Ranges[0].Length = bytes;
+
+        retVal = DeviceIoControl(
+                targetHandle,
+                FSCTL_FILE_LEVEL_TRIM,
+                &fileTrim,
+                sizeof( fileTrim ),
+                NULL,
+                0,
+                &bytesReturned,
+                &overlapped );
+    }
+
+    DWORD error = retVal ? ERROR_SUCCESS : GetLastError();
+
+    if( error == ERROR_IO_PENDING )
+    {
+        retVal = GetOverlappedResult(
+                targetHandle,
+                &overlapped,
+                &bytesReturned,
+                true );
+
+        error = retVal ? ERROR_SUCCESS : GetLastError();
+    }
+
+    CloseHandle( event );
+
+    return error;
+}
+
+// Anything we can't query keeps the TargetGeometry default
+TargetGeometry queryTargetGeometry( HANDLE targetHandle, bool rawDisk )
+{
+    TargetGeometry geometry;
+
+    if( rawDisk )
+    {
+        STORAGE_PROPERTY_QUERY query = {};
+        STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment = {0};
+        OVERLAPPED overlapped = {0};
+        DWORD bytesReturned = 0;
+
+        query.PropertyId = StorageAccessAlignmentProperty;
+        query.QueryType = PropertyStandardQuery;
+
+        HANDLE event = checkedCreateEvent( false );
+
+        overlapped.hEvent = event;
+
+        bool retVal = DeviceIoControl(
+                targetHandle,
+                IOCTL_STORAGE_QUERY_PROPERTY,
+                &query,
+                sizeof( query ),
+                &alignment,
+                sizeof( alignment ),
+                &bytesReturned,
+                &overlapped );
+
+        if( !retVal && ( GetLastError() == ERROR_IO_PENDING ) )
+        {
+            retVal = GetOverlappedResult(
+                    targetHandle,
+                    &overlapped,
+                    &bytesReturned,
+                    true );
+        }
+
+        CloseHandle( event );
+
+        if( retVal && ( bytesReturned >= sizeof( alignment ) ) )
+        {
+            geometry.logicalSectorSize = alignment.BytesPerLogicalSector;
+            geometry.physicalSectorSize = alignment.BytesPerPhysicalSector;
+        }
+    }
+    else
+    {
+        FILE_STORAGE_INFO info = {0};
+
+        if( GetFileInformationByHandleEx( 
+                targetHandle, FileStorageInfo, &info, sizeof( info ) ) )
+        {
+            geometry.logicalSectorSize = info.LogicalBytesPerSector;
+            geometry.physicalSectorSize = 
+                info.PhysicalBytesPerSectorForPerformance;
+        }
+    }
+
+    geometry.physicalSectorSize = std::max( 
+        geometry.physicalSectorSize, geometry.logicalSectorSize );
+
+    return geometry;
+}
+
 void checkedFlushFileBuffers( HANDLE targetHandle )
 {
     using namespace std;
@@ -306,4 +588,161 @@ void checkedReadFileEx(
         exit( EXIT_FAILURE );
     }
 }
+#else // !_WIN32
+int checkedOpenTarget( std::string targetName )
+{
+    using namespace std;
+
+    // O_DIRECT and O_DSYNC are the moral equivalents of
+    // FILE_FLAG_NO_BUFFERING and FILE_FLAG_WRITE_THROUGH
+    int fd = open( targetName.c_str(), O_RDWR | O_DIRECT | O_DSYNC );
+
+    if( fd < 0 )
+    {
+        int error = errno;
+
+        cerr
+            << "open failed. errno = "
+            << error << " (" << strerror( error ) << ")" << endl;
+
+        if( ( error == EACCES ) || ( error == EPERM ) )
+        {
+            cerr 
+                << "Are you running as root?" 
+                << endl;
+        }
+
+        exit( EXIT_FAILURE );
+    }
+
+    return fd;
+}
+
+int64_t checkedGetTargetSize( int fd )
+{
+    using namespace std;
+
+    struct stat st;
+
+    if( fstat( fd, &st ) != 0 )
+    {
+        cerr << "fstat failed. errno = " << errno << endl;
+
+        exit( EXIT_FAILURE );
+    }
+
+    if( !S_ISBLK( st.st_mode ) )
+    {
+        return st.st_size;
+    }
+
+    uint64_t diskLength = 0;
+
+    if( ioctl( fd, BLKGETSIZE64, &diskLength ) != 0 )
+    {
+        cerr << "ioctl(BLKGETSIZE64) failed. errno = " << errno << endl;
+
+        exit( EXIT_FAILURE );
+    }
+
+    return static_cast<int64_t>( diskLength );
+}
+
+bool isBlockDevice( int fd )
+{
+    struct stat st;
+
+    return ( fstat( fd, &st ) == 0 ) && S_ISBLK( st.st_mode );
+}
+
+// Anything we can't query keeps the TargetGeometry default
+TargetGeometry queryTargetGeometry( int fd )
+{
+    TargetGeometry geometry;
+
+    if( isBlockDevice( fd ) )
+    {
+        int logical = 0;
+        unsigned int physical = 0;
+        unsigned int optimal = 0;
+
+        if( ioctl( fd, BLKSSZGET, &logical ) == 0 )
+        {
+            geometry.logicalSectorSize = logical;
+        }
+
+        if( ioctl( fd, BLKPBSZGET, &physical ) == 0 )
+        {
+            geometry.physicalSectorSize = physical;
+        }
+
+        if( ioctl( fd, BLKIOOPT, &optimal ) == 0 )
+        {
+            geometry.optimalIOSize = optimal;
+        }
+    }
+    else
+    {
+#ifdef STATX_DIOALIGN
+        // O_DIRECT to a file needs whatever the file system needs
+        struct statx stx;
+
+        if( ( statx( fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx ) == 0 ) &&
+                ( stx.stx_mask & STATX_DIOALIGN ) && 
+                ( stx.stx_dio_offset_align > 0 ) )
+        {
+            geometry.logicalSectorSize = stx.stx_dio_offset_align;
+        }
+#endif
+        // Smaller writes make the file system read-modify-write a block
+        struct stat st;
+
+        if( fstat( fd, &st ) == 0 )
+        {
+            geometry.physicalSectorSize = st.st_blksize;
+            geometry.optimalIOSize = st.st_blksize;
+        }
+    }
+
+    geometry.physicalSectorSize = std::max( 
+        geometry.physicalSectorSize, geometry.logicalSectorSize );
+
+    return geometry;
+}
+
+// Deallocates a range: BLKDISCARD on a block device, or a punched hole
+// in a file.  Blocks until done.  Returns 0 or errno.
+int discardRange( int fd, bool blockDevice, int64_t offset, int64_t bytes )
+{
+    int retVal;
+
+    if( blockDevice )
+    {
+        uint64_t range[2] = { 
+            static_cast<uint64_t>( offset ), 
+            static_cast<uint64_t>( bytes ) };
+
+        retVal = ioctl( fd, BLKDISCARD, range );
+    }
+    else
+    {
+        retVal = fallocate( 
+            fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, bytes );
+    }
+
+    return ( retVal == 0 ) ? 0 : errno;
+}
+
+void checkedFsync( int fd )
+{
+    using namespace std;
+
+    if( fsync( fd ) != 0 )
+    {
+        cerr << "fsync failed. errno = " << errno << endl;
+
+        exit( EXIT_FAILURE );
+    }
+}
+#endif // _WIN32
 #endif // __WRITE_TARGET_H_
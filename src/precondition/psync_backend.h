@@ -0,0 +1,259 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __PSYNC_BACKEND_H_
+#define __PSYNC_BACKEND_H_
+
+#ifndef _WIN32
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+#include "precondition.h"
+#include "io_backend.h"
+
+// Last resort: one thread per outstanding IO, each doing blocking
+// pread/pwrite.  Works anywhere there is a POSIX kernel underneath,
+// seccomp sandboxes included, at the price of a context switch and a
+// lock round trip per IO.  Discards are just another blocking call on
+// one of those threads.
+class PsyncBackend : public IOBackend
+{
+    private:
+
+    int targetFd_;
+    bool blockDevice_;
+    const int64_t NUM_THREADS;
+
+    std::vector< std::thread > threads_;
+
+    std::mutex mutex_;
+    std::condition_variable requestReady_;
+    std::condition_variable completionReady_;
+
+    std::deque< IORequest > requests_;
+    std::vector< IOCompletion > completed_;
+
+    // Submitted but not yet reaped
+    int64_t inFlight_;
+    bool stopping_;
+
+    public:
+
+    PsyncBackend( int64_t queueDepth )
+        : targetFd_( -1 )
+        , blockDevice_( false )
+        , NUM_THREADS( queueDepth )
+        , inFlight_( 0 )
+        , stopping_( false )
+    {
+        completed_.reserve( queueDepth );
+    }
+
+    ~PsyncBackend()
+    {
+        stopThreads();
+    }
+
+    std::string getName() const
+    {
+        return "psync";
+    }
+
+    void openTarget( const std::string& targetName, bool /* rawDisk */ )
+    {
+        targetFd_ = checkedOpenTarget( targetName );
+        blockDevice_ = isBlockDevice( targetFd_ );
+
+        for( int64_t i = 0; i < NUM_THREADS; ++i )
+        {
+            threads_.push_back(
+                std::thread( &PsyncBackend::workerThread, this ) );
+        }
+    }
+
+    void closeTarget()
+    {
+        stopThreads();
+
+        close( targetFd_ );
+        targetFd_ = -1;
+    }
+
+    int64_t getTargetSize()
+    {
+        return checkedGetTargetSize( targetFd_ );
+    }
+
+    TargetGeometry getTargetGeometry()
+    {
+        return queryTargetGeometry( targetFd_ );
+    }
+
+    void submit( const IORequest& request )
+    {
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+
+            requests_.push_back( request );
+            inFlight_++;
+        }
+
+        requestReady_.notify_one();
+    }
+
+    size_t reap(
+        std::vector<IOCompletion>& completions,
+        int64_t timeoutNanoseconds,
+        size_t minCompletions )
+    {
+        std::unique_lock<std::mutex> lock( mutex_ );
+
+        assert( inFlight_ > 0 );
+
+        size_t wanted = std::min<size_t>( minCompletions, inFlight_ );
+
+        auto isReady = [this, wanted]{ return completed_.size() >= wanted; };
+
+        if( timeoutNanoseconds == WAIT_FOREVER )
+        {
+            completionReady_.wait( lock, isReady );
+        }
+        else if( !completionReady_.wait_for( lock,
+                    std::chrono::nanoseconds( timeoutNanoseconds ), isReady ) )
+        {
+            return 0;
+        }
+
+        size_t numReaped = completed_.size();
+
+        completions.insert(
+            completions.end(), completed_.begin(), completed_.end() );
+
+        completed_.clear();
+
+        inFlight_ -= numReaped;
+
+        return numReaped;
+    }
+
+    void cancel()
+    {
+        std::unique_lock<std::mutex> lock( mutex_ );
+
+        // Anything a worker hasn't picked up yet is simply dropped
+        inFlight_ -= requests_.size();
+        requests_.clear();
+
+        completionReady_.wait( lock, [this]{
+            return static_cast<int64_t>( completed_.size() ) == inFlight_;
+        } );
+
+        completed_.clear();
+        inFlight_ = 0;
+    }
+
+    void flush()
+    {
+        checkedFsync( targetFd_ );
+    }
+
+    private:
+
+    void stopThreads()
+    {
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+            stopping_ = true;
+        }
+
+        requestReady_.notify_all();
+
+        for( auto &t: threads_ )
+        {
+            t.join();
+        }
+
+        threads_.clear();
+    }
+
+    void workerThread()
+    {
+        for( ;; )
+        {
+            IORequest request;
+
+            {
+                std::unique_lock<std::mutex> lock( mutex_ );
+
+                requestReady_.wait( lock, 
+                    [this]{ return stopping_ || !requests_.empty(); } );
+
+                if( stopping_ ) return;
+
+                request = requests_.front();
+                requests_.pop_front();
+            }
+
+            IOCompletion completion;
+
+            completion.slot = request.slot;
+
+            if( request.isDiscard )
+            {
+                completion.error = discardRange( 
+                    targetFd_, blockDevice_, request.offset, request.bytes );
+                completion.bytes = 
+                    ( completion.error == 0 ) ? request.bytes : 0;
+            }
+            else
+            {
+                ssize_t retVal = request.isWrite ?
+                    pwrite( targetFd_, 
+                        request.buffer, request.bytes, request.offset ) :
+                    pread( targetFd_, 
+                        request.buffer, request.bytes, request.offset );
+
+                completion.bytes = ( retVal < 0 ) ? 0 : retVal;
+                completion.error = ( retVal < 0 ) ? errno : 0;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock( mutex_ );
+
+                completed_.push_back( completion );
+            }
+
+            completionReady_.notify_one();
+        }
+    }
+};
+
+#endif // !_WIN32
+#endif // __PSYNC_BACKEND_H_
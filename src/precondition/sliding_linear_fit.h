@@ -0,0 +1,158 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __SLIDING_LINEAR_FIT_H_
+#define __SLIDING_LINEAR_FIT_H_
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <tuple>
+#include <stdexcept>
+
+// Neumaier's variant of Kahan summation.  Keeps the rounding error of
+// every add() in a second accumulator, so a sum that has values added
+// and removed millions of times doesn't drift away from the truth.
+class CompensatedSum
+{
+    private:
+
+    double sum_;
+    double compensation_;
+
+    public:
+
+    CompensatedSum()
+        : sum_( 0 )
+        , compensation_( 0 )
+    {}
+
+    void add( double x )
+    {
+        double t = sum_ + x;
+
+        if( std::abs( sum_ ) >= std::abs( x ) )
+        {
+            compensation_ += ( sum_ - t ) + x;
+        }
+        else
+        {
+            compensation_ += ( x - t ) + sum_;
+        }
+
+        sum_ = t;
+    }
+
+    double get() const
+    {
+        return sum_ + compensation_;
+    }
+};
+
+// Least-squares fit of y against x = 1, 2, ... WINDOW_SIZE over a window
+// that slides one point at a time.  Rather than revisit the window on
+// each slide, keep running sums of y, xy and y^2 and patch them up in
+// O(1).  The x terms never change, so they are computed once.
+//
+// All state is per-instance; any number of these may run at once.
+class SlidingLinearFit
+{
+    private:
+
+    const double WINDOW_SIZE;
+
+    // Constants for linear regression
+    const double SUM_X;
+    const double SUM_SQ_X;
+    const double VAR_X;
+    const double STD_DEV_X;
+
+    CompensatedSum sumY_;
+    CompensatedSum sumXY_;
+    CompensatedSum sumSqY_;
+
+    public:
+
+    // Starts out as a window of zeros
+    explicit SlidingLinearFit( int64_t windowSize )
+        : WINDOW_SIZE( static_cast<double>( windowSize ) )
+        , SUM_X( WINDOW_SIZE * ( WINDOW_SIZE + 1 ) / 2 )
+        , SUM_SQ_X( 
+            WINDOW_SIZE * ( WINDOW_SIZE + 1 ) * ( 2 * WINDOW_SIZE + 1 ) / 6 )
+        , VAR_X( SUM_SQ_X - ( ( SUM_X * SUM_X ) / WINDOW_SIZE ) )
+        , STD_DEV_X( std::sqrt( VAR_X ) )
+    {
+        if( windowSize < 2 )
+        {
+            throw std::invalid_argument( "Window of 2 or more required" );
+        }
+    }
+
+    // Drop the oldest point, at x = 1, and append a new one at
+    // x = WINDOW_SIZE.  Every surviving point moves down by one.
+    void slide( double oldest, double newest )
+    {
+        // Shifting every x down by one subtracts sum_y from sum_xy.
+        // The oldest point's own term (1 * oldest) goes with it.
+        sumXY_.add( -sumY_.get() );
+        sumXY_.add( WINDOW_SIZE * newest );
+
+        sumY_.add( -oldest );
+        sumY_.add( newest );
+
+        sumSqY_.add( -oldest * oldest );
+        sumSqY_.add( newest * newest );
+    }
+
+    // Returns slope and R^2
+    std::tuple<double, double> get() const
+    {
+        const double sum_y = sumY_.get();
+
+        const double covar_xy =
+            sumXY_.get() - ( ( SUM_X * sum_y ) / WINDOW_SIZE );
+
+        // Can't be negative, but rounding might make it so
+        const double var_y = std::max( 0.0,
+            sumSqY_.get() - ( ( sum_y * sum_y ) / WINDOW_SIZE ) );
+
+        const double slope = covar_xy / VAR_X;
+
+        double rSquared = 0;
+
+        if( var_y > 0 )
+        {
+            const double corr = covar_xy / ( STD_DEV_X * std::sqrt( var_y ) );
+
+            rSquared = corr * corr;
+        }
+
+        return std::make_tuple( slope, rSquared );
+    }
+};
+
+#endif // __SLIDING_LINEAR_FIT_H_
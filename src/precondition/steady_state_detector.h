@@ -32,13 +32,16 @@
 #include <cstdint>
 #include <algorithm>
 #include <stdexcept>
-#include <numeric>
 #include <sstream>
 #include <iomanip>
 #include <iterator>
+#include <cmath>
+#include <memory>
+
+#include "latency_histogram.h"
+#include "steady_state_policy.h"
 
 #include <boost/utility.hpp>
-#include <boost/iterator/counting_iterator.hpp>
 #include <boost/iterator/iterator_facade.hpp>
 
 // STL expects iterators to behave sanely.  When operating on a range
@@ -208,20 +211,25 @@ class SteadyStateDetector
     static const int DEFAULT_GATHER_SECONDS = 540; // 9 minutes
     static const int DEFAULT_DWELL_SECONDS = 60; // 1 minute
     static const double DEFAULT_SLOPE_TOLERANCE;
+    static const double DEFAULT_LATENCY_TOLERANCE;
+    static const SteadyStatePolicyType DEFAULT_POLICY = SLOPE_POLICY;
 
     private:
 
-    int numValidBins_;
+    size_t numValidBins_;
     int64_t nextBinStartTime_;
+    int64_t lastTrackTime_;
     
     bool possibleSteadyState_;
     int64_t dwellStart_;
-   
-    mutable bool changed_;
+
+    bool policyWithinTolerance_;
 
     const size_t GATHER_SECONDS;
     const size_t DWELL_SECONDS;
-    const double SLOPE_TOLERANCE;
+
+    // Zero disables the latency criterion
+    const double LATENCY_TOLERANCE;
 
     const size_t NUM_BINS;
     const int64_t QPC_TICKS_PER_BIN;
@@ -232,48 +240,68 @@ class SteadyStateDetector
 
     circular_buffer<int64_t> data_;
 
-    // Constants for linear regression
-    const double SUM_X;
-    const double SUM_SQ_X;
-    const double VAR_X;
-    const double STD_DEV_X;
+    // Judges every bin but the one in progress
+    std::unique_ptr<SteadyStatePolicy> policy_;
+
+    // The gather window is also cut into NUM_LATENCY_WINDOWS slices, each
+    // with its own latency histogram.  The distribution has settled when
+    // every slice is within LATENCY_TOLERANCE of the one before it.
+    static const int NUM_LATENCY_WINDOWS = 10;
+
+    const int64_t QPC_TICKS_PER_LATENCY_WINDOW;
+    int64_t nextLatencyWindowTime_;
+
+    std::vector< LatencyHistogram > latencyWindows_;
+    int numValidLatencyWindows_;
+    int newestLatencyWindow_;
+    double latencyDrift_;
 
     public:
 
     SteadyStateDetector( 
             size_t gather_sec = DEFAULT_GATHER_SECONDS,
             size_t dwell_sec = DEFAULT_DWELL_SECONDS,
-            double slope_toler = DEFAULT_SLOPE_TOLERANCE )
+            double slope_toler = DEFAULT_SLOPE_TOLERANCE,
+            double bin_scale = 1,
+            double latency_toler = 0,
+            SteadyStatePolicyType policy = DEFAULT_POLICY )
         : numValidBins_( 0 )
         , possibleSteadyState_( false )
-        , changed_( false )
+        , policyWithinTolerance_( false )
         , GATHER_SECONDS( gather_sec )
         , DWELL_SECONDS( dwell_sec )
-        , SLOPE_TOLERANCE( slope_toler )
+        , LATENCY_TOLERANCE( latency_toler )
         , NUM_BINS( GATHER_SECONDS * BINS_PER_SECOND )
         , QPC_TICKS_PER_BIN( QPC_TICKS_PER_SEC / BINS_PER_SECOND )
         , data_( NUM_BINS, 0 )
-        , SUM_X(
-                std::accumulate(
-                    boost::counting_iterator<int64_t>( 1 ),
-                    boost::counting_iterator<int64_t>( NUM_BINS ),
-                    0.0 ) )
-        , SUM_SQ_X(
-                std::inner_product(
-                    boost::counting_iterator<int64_t>( 1 ),
-                    boost::counting_iterator<int64_t>( NUM_BINS ),
-                    boost::counting_iterator<int64_t>( 1 ),
-                    0.0 ) )
-        , VAR_X( SUM_SQ_X - ( ( SUM_X * SUM_X ) / ( NUM_BINS - 1 ) ) )
-        , STD_DEV_X( std::sqrt( VAR_X ) )
+        , QPC_TICKS_PER_LATENCY_WINDOW( 
+            GATHER_SECONDS * QPC_TICKS_PER_SEC / NUM_LATENCY_WINDOWS )
+        , latencyWindows_( LATENCY_TOLERANCE > 0 ? NUM_LATENCY_WINDOWS : 0 )
+        , numValidLatencyWindows_( 0 )
+        , newestLatencyWindow_( 0 )
+        , latencyDrift_( 0 )
     {
         if( GATHER_SECONDS == 0 )
         {
             throw std::invalid_argument( "Non-zero window required" );
         }
+
+        if( policy == PTS_POLICY )
+        {
+            policy_.reset( new PtsPolicy( NUM_BINS - 1 ) );
+        }
+        else
+        {
+            policy_.reset( 
+                new SlopePolicy( NUM_BINS - 1, slope_toler, bin_scale ) );
+        }
     }
 
-    void trackCompletion()
+    // Count completions (or bytes) observed since the last call.
+    // Callers that sample periodically, rather than once per IO, get
+    // their count spread evenly over the time since the previous sample,
+    // so bins stay accurate even when samples straddle a bin boundary.
+    void trackCompletions( int64_t count = 1 )
     {
         int64_t now = qpc(); 
     
@@ -281,48 +309,97 @@ class SteadyStateDetector
         {
             // Initialize on 1st call
             nextBinStartTime_ = now + QPC_TICKS_PER_BIN;
+            nextLatencyWindowTime_ = now + QPC_TICKS_PER_LATENCY_WINDOW;
+            lastTrackTime_ = now;
             numValidBins_ = 1;
         }
 
         while( now >= nextBinStartTime_ )
         {
+            int64_t share = static_cast<int64_t>( 
+                static_cast<double>( count ) *
+                ( nextBinStartTime_ - lastTrackTime_ ) /
+                ( now - lastTrackTime_ ) );
+
+            data_.current() += share;
+            count -= share;
+            lastTrackTime_ = nextBinStartTime_;
+
+            int64_t newest = data_.current();
+
+            // Now pointing at the oldest bin, about to be recycled
             data_.advance();
-            changed_ = true;
+
+            policy_->trackBin(
+                static_cast<double>( data_.current() ),
+                static_cast<double>( newest ) );
 
             data_.current() = 0;
        
             numValidBins_ = 
-                std::min<int64_t>( numValidBins_ + 1, NUM_BINS );
+                std::min<size_t>( numValidBins_ + 1, NUM_BINS );
 
             nextBinStartTime_ += QPC_TICKS_PER_BIN;
         }
             
-        data_.current()++;
+        data_.current() += count;
+        lastTrackTime_ = now;
         
-        if( full() )
+        if( binsFull() )
         {
-            double slope;
-            double rSquared;
+            policyWithinTolerance_ = policy_->withinTolerance();
 
-            std::tie( slope, rSquared ) = getLinearFit();
+            updatePossibleSteadyState();
+        }
+    }
 
-            // ISSUE_REVIEW: should we also have an R^2 tolerance?
-            // An R^2 close to 1.0 indicates a good fit, but ours
-            // are often terrible... 0.01 or worse.
-            if( abs( slope ) <= SLOPE_TOLERANCE )
-            {
-                if( possibleSteadyState_ == false )
-                {
-                    dwellStart_ = qpc();
-                }
+    bool tracksLatency() const
+    {
+        return LATENCY_TOLERANCE > 0;
+    }
 
-                possibleSteadyState_ = true;
-            }
-            else
-            {
-                possibleSteadyState_ = false;
-            }
+    // True when the caller should hand us the latency histogram of the
+    // IOs completed since the previous window.  Building one means
+    // merging every worker's histogram, so we don't ask very often.
+    bool latencyWindowDue() const
+    {
+        return tracksLatency() && ( numValidBins_ > 0 ) &&
+            ( qpc() >= nextLatencyWindowTime_ );
+    }
+
+    void trackLatencyWindow( const LatencyHistogram &window )
+    {
+        assert( tracksLatency() );
+
+        nextLatencyWindowTime_ += QPC_TICKS_PER_LATENCY_WINDOW;
+
+        newestLatencyWindow_ = 
+            ( newestLatencyWindow_ + 1 ) % NUM_LATENCY_WINDOWS;
+
+        LatencyHistogram &newest = latencyWindows_[newestLatencyWindow_];
+
+        newest.reset();
+        newest.merge( window );
+
+        numValidLatencyWindows_ = 
+            std::min( numValidLatencyWindows_ + 1, NUM_LATENCY_WINDOWS );
+
+        if( numValidLatencyWindows_ < NUM_LATENCY_WINDOWS ) return;
+
+        // Worst drift between consecutive windows, oldest to newest
+        latencyDrift_ = 0;
+
+        for( int i = 1; i < NUM_LATENCY_WINDOWS; ++i )
+        {
+            int current = ( newestLatencyWindow_ + 1 + i ) % NUM_LATENCY_WINDOWS;
+            int previous = ( newestLatencyWindow_ + i ) % NUM_LATENCY_WINDOWS;
+
+            latencyDrift_ = std::max( latencyDrift_,
+                LatencyHistogram::getRelativeDistance( 
+                    latencyWindows_[previous], latencyWindows_[current] ) );
         }
+
+        updatePossibleSteadyState();
     }
     
     std::string getProgressMessage() const
@@ -355,52 +432,56 @@ class SteadyStateDetector
            
             dwellPercent = std::min( dwellPercent, 100.0 );
 
-            double slope;
-            double rSquared;
-
-            std::tie( slope, rSquared ) = getLinearFit();
-
             std::ostringstream msg;
             
             msg << "dwelling "
                 << std::setiosflags( std::ios::fixed )
                 << std::setprecision( 1 )
                 << dwellPercent
-                << "%, slope "
-                << std::setprecision( 4 )
-                << slope;
-                //<< ", R^2 "
-                //<< rSquared;
+                << "%, "
+                << policy_->getProgressMessage();
+
+            msg << getLatencyDriftMessage();
 
             return msg.str();
         }
         else
         {
-            double slope;
-            double rSquared;
-
-            std::tie( slope, rSquared ) = getLinearFit();
-
             std::ostringstream msg;
                 
-            msg << "awaiting steady-state, slope "
-                << std::setiosflags( std::ios::fixed )
-                << std::setprecision( 4 )
-                << slope;
-                //<< ", R^2 "
-                //<< rSquared;
+            msg << "awaiting steady-state, "
+                << policy_->getProgressMessage();
+
+            msg << getLatencyDriftMessage();
             
             return msg.str();
         }
     }
   
+    // The rules steady-state was judged by, for the report
+    std::string getCriterion() const
+    {
+        std::ostringstream msg;
+
+        msg << policy_->getCriterion();
+
+        if( tracksLatency() )
+        {
+            msg << ", latency drift within "
+                << LATENCY_TOLERANCE * 100 << "%";
+        }
+
+        return msg.str();
+    }
+  
     bool done() const
     {
         if( !full() ) return false;
 
         if( possibleSteadyState_ )
         {
-            int secondsInSteadyState = secondsSince( dwellStart_ );
+            size_t secondsInSteadyState = 
+                static_cast<size_t>( secondsSince( dwellStart_ ) );
 
             if( secondsInSteadyState >= DWELL_SECONDS )
             {
@@ -413,73 +494,66 @@ class SteadyStateDetector
 
     private:
     
-    bool full() const
+    bool binsFull() const
     {
         if( numValidBins_ < NUM_BINS ) return false;
 
         return true;
     }
-   
-    // N.B. 
-    // It's critical that we perform this linear regression without
-    // becoming CPU-limited.  We need to remain IO bound so we are
-    // actually measuring the storage device. --MarkSan
-    std::tuple<double, double> getLinearFit() const
+
+    bool full() const
     {
-        if( !full() )
+        if( !binsFull() || !policy_->full() ) return false;
+
+        if( tracksLatency() && 
+                ( numValidLatencyWindows_ < NUM_LATENCY_WINDOWS ) )
         {
-            throw std::runtime_error( "called too soon" );
+            return false;
         }
 
-        static double currentSlope = 0;
-        static double currentRSquared = 0;
+        return true;
+    }
 
-        if( !changed_ )
+    void updatePossibleSteadyState()
+    {
+        bool withinTolerance = policyWithinTolerance_ && full();
+
+        if( tracksLatency() )
         {
-            return std::make_pair( currentSlope, currentRSquared );
+            withinTolerance &= ( latencyDrift_ <= LATENCY_TOLERANCE );
         }
 
-        const double sum_y =
-            std::accumulate( data_.begin(), data_.end(), 0.0 );
-        
-        const double sum_xy =
-            std::inner_product(
-                boost::counting_iterator<int64_t>( 1 ),
-                boost::counting_iterator<int64_t>( NUM_BINS ),
-                data_.begin(),
-                0.0
-            );
-     
-        const double covar_xy = 
-            sum_xy - ( ( SUM_X * sum_y ) / ( NUM_BINS - 1 ) );
-        
-        const double sum_sq_y =
-            std::inner_product(
-                data_.begin(),
-                data_.end(),
-                data_.begin(),
-                0.0
-            );
+        if( withinTolerance )
+        {
+            if( possibleSteadyState_ == false )
+            {
+                dwellStart_ = qpc();
+            }
 
-        const double var_y =
-            sum_sq_y - ( ( sum_y * sum_y ) / ( NUM_BINS - 1 ) );
+            possibleSteadyState_ = true;
+        }
+        else
+        {
+            possibleSteadyState_ = false;
+        }
+    }
 
-        const double std_dev_y = std::sqrt( var_y );
+    std::string getLatencyDriftMessage() const
+    {
+        if( !tracksLatency() ) return "";
 
-        const double corr = covar_xy / ( STD_DEV_X * std_dev_y );
-        
-        currentSlope = covar_xy / VAR_X;
-        currentRSquared = corr * corr;
-        
-        //double currentIntercept =
-        //    ( sum_y - currentSlope * SUM_X ) / NUM_BINS - 1;
+        std::ostringstream msg;
 
-        changed_ = false;
-        
-        return std::make_pair( currentSlope, currentRSquared );
+        msg << ", latency drift "
+            << std::setiosflags( std::ios::fixed )
+            << std::setprecision( 1 )
+            << latencyDrift_ * 100 << "%";
+
+        return msg.str();
     }
 };
 
 const double SteadyStateDetector::DEFAULT_SLOPE_TOLERANCE = 0.001; 
+const double SteadyStateDetector::DEFAULT_LATENCY_TOLERANCE = 0.05; 
 
 #endif // __STEADY_STATE_DETECTOR_H_
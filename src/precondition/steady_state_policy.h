@@ -0,0 +1,299 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __STEADY_STATE_POLICY_H_
+#define __STEADY_STATE_POLICY_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+#include <boost/utility.hpp>
+
+#include "sliding_linear_fit.h"
+
+enum SteadyStatePolicyType { SLOPE_POLICY, PTS_POLICY };
+
+std::string steadyStatePolicyToString( const SteadyStatePolicyType& p )
+{
+    return ( p == SLOPE_POLICY ) ? "slope" : "pts";
+}
+
+// Decides whether the binned throughput SteadyStateDetector feeds it
+// has stopped changing.  The detector owns the bins, the gather and
+// dwell timing, and any latency criterion; a policy only judges the
+// window of completed bins.
+class SteadyStatePolicy : boost::noncopyable
+{
+    public:
+
+    virtual ~SteadyStatePolicy() {}
+
+    // Called each time a bin completes.  The window slides by one:
+    // oldest leaves and newest enters.
+    virtual void trackBin( double oldest, double newest ) = 0;
+
+    // Whether the policy has seen enough bins to judge.  The detector
+    // separately waits for its window of bins to fill.
+    virtual bool full() const = 0;
+
+    virtual bool withinTolerance() const = 0;
+
+    // e.g. "slope 0.0012"
+    virtual std::string getProgressMessage() const = 0;
+
+    // The rule, stated for the report
+    virtual std::string getCriterion() const = 0;
+};
+
+// The original rule: the slope of a least-squares fit over every bin
+// in the window must be within SLOPE_TOLERANCE of flat.
+class SlopePolicy : public SteadyStatePolicy
+{
+    private:
+
+    const double SLOPE_TOLERANCE;
+
+    // Slopes are divided by this before comparing against the tolerance.
+    // Lets callers that bin bytes express the tolerance in blocks.
+    const double BIN_SCALE;
+
+    SlidingLinearFit fit_;
+
+    public:
+
+    SlopePolicy( size_t windowBins, double slopeTolerance, double binScale )
+        : SLOPE_TOLERANCE( slopeTolerance )
+        , BIN_SCALE( binScale )
+        , fit_( windowBins )
+    {}
+
+    virtual void trackBin( double oldest, double newest )
+    {
+        fit_.slide( oldest, newest );
+    }
+
+    virtual bool full() const
+    {
+        return true;
+    }
+
+    virtual bool withinTolerance() const
+    {
+        // ISSUE_REVIEW: should we also have an R^2 tolerance?
+        // An R^2 close to 1.0 indicates a good fit, but ours
+        // are often terrible... 0.01 or worse.
+        return std::abs( getSlope() ) <= SLOPE_TOLERANCE;
+    }
+
+    virtual std::string getProgressMessage() const
+    {
+        std::ostringstream msg;
+
+        msg << "slope "
+            << std::setiosflags( std::ios::fixed )
+            << std::setprecision( 4 )
+            << getSlope();
+
+        return msg.str();
+    }
+
+    virtual std::string getCriterion() const
+    {
+        std::ostringstream msg;
+
+        msg << "slope within " << SLOPE_TOLERANCE;
+
+        return msg.str();
+    }
+
+    private:
+
+    // N.B. 
+    // It's critical that we perform this linear regression without
+    // becoming CPU-limited.  We need to remain IO bound so we are
+    // actually measuring the storage device. --MarkSan
+    //
+    // SlidingLinearFit keeps running sums, so this is O(1) no matter
+    // how long the gather window is.
+    double getSlope() const
+    {
+        double slope;
+        double rSquared;
+
+        std::tie( slope, rSquared ) = fit_.get();
+
+        return slope / BIN_SCALE;
+    }
+};
+
+// The SNIA Solid State Storage Performance Test Specification rule.
+// The window is cut into NUM_ROUNDS rounds.  Over the last NUM_ROUNDS
+// rounds, every round must be within DATA_EXCURSION of the average
+// round, and the best-fit line across them may rise or fall by no
+// more than SLOPE_EXCURSION of the average.
+class PtsPolicy : public SteadyStatePolicy
+{
+    private:
+
+    static const int NUM_ROUNDS = 5;
+
+    static const double DATA_EXCURSION;
+    static const double SLOPE_EXCURSION;
+
+    const int64_t BINS_PER_ROUND;
+
+    std::vector<double> rounds_;
+    int numValidRounds_;
+    int oldestRound_;
+
+    double roundTotal_;
+    int64_t binsInRound_;
+
+    SlidingLinearFit fit_;
+
+    double dataExcursion_;
+    double slopeExcursion_;
+
+    public:
+
+    explicit PtsPolicy( size_t windowBins )
+        : BINS_PER_ROUND( 
+            std::max<int64_t>( 1, windowBins / NUM_ROUNDS ) )
+        , rounds_( NUM_ROUNDS, 0 )
+        , numValidRounds_( 0 )
+        , oldestRound_( 0 )
+        , roundTotal_( 0 )
+        , binsInRound_( 0 )
+        , fit_( NUM_ROUNDS )
+        , dataExcursion_( 0 )
+        , slopeExcursion_( 0 )
+    {}
+
+    virtual void trackBin( double /* oldest */, double newest )
+    {
+        roundTotal_ += newest;
+
+        if( ++binsInRound_ < BINS_PER_ROUND ) return;
+
+        fit_.slide( rounds_[oldestRound_], roundTotal_ );
+
+        rounds_[oldestRound_] = roundTotal_;
+        oldestRound_ = ( oldestRound_ + 1 ) % NUM_ROUNDS;
+
+        numValidRounds_ = std::min( numValidRounds_ + 1, NUM_ROUNDS );
+
+        roundTotal_ = 0;
+        binsInRound_ = 0;
+
+        updateExcursions();
+    }
+
+    virtual bool full() const
+    {
+        return numValidRounds_ == NUM_ROUNDS;
+    }
+
+    virtual bool withinTolerance() const
+    {
+        return full() &&
+            ( dataExcursion_ <= DATA_EXCURSION ) &&
+            ( slopeExcursion_ <= SLOPE_EXCURSION );
+    }
+
+    virtual std::string getProgressMessage() const
+    {
+        std::ostringstream msg;
+
+        msg << "excursion "
+            << std::setiosflags( std::ios::fixed )
+            << std::setprecision( 1 )
+            << dataExcursion_ * 100
+            << "%, slope excursion "
+            << slopeExcursion_ * 100 << "%";
+
+        return msg.str();
+    }
+
+    virtual std::string getCriterion() const
+    {
+        std::ostringstream msg;
+
+        msg << "SNIA PTS, " << NUM_ROUNDS << " rounds, data excursion within "
+            << DATA_EXCURSION * 100 << "%, slope excursion within "
+            << SLOPE_EXCURSION * 100 << "%";
+
+        return msg.str();
+    }
+
+    private:
+
+    void updateExcursions()
+    {
+        if( !full() ) return;
+
+        const double maxRound = 
+            *std::max_element( rounds_.begin(), rounds_.end() );
+
+        const double minRound = 
+            *std::min_element( rounds_.begin(), rounds_.end() );
+
+        double sum = 0;
+
+        for( auto r: rounds_ )
+        {
+            sum += r;
+        }
+
+        const double average = sum / NUM_ROUNDS;
+
+        if( average <= 0 )
+        {
+            // Nothing completed at all.  Not what anyone means by steady.
+            dataExcursion_ = slopeExcursion_ = 1;
+            return;
+        }
+
+        double slope;
+        double rSquared;
+
+        std::tie( slope, rSquared ) = fit_.get();
+
+        // The PTS expresses both as a fraction of the average
+        dataExcursion_ = ( maxRound - minRound ) / average;
+        slopeExcursion_ = std::abs( slope ) * ( NUM_ROUNDS - 1 ) / average;
+    }
+};
+
+const double PtsPolicy::DATA_EXCURSION = 0.20;
+const double PtsPolicy::SLOPE_EXCURSION = 0.10;
+
+#endif // __STEADY_STATE_POLICY_H_
@@ -0,0 +1,310 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __TIME_SERIES_H_
+#define __TIME_SERIES_H_
+
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <deque>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+
+#include "latency_histogram.h"
+
+// One interval of a run.  Latency is kept far coarser than in
+// LatencyHistogram, just enough to draw a time x latency heatmap:
+// bucket i counts IOs that took [2^(i/2), 2^((i+1)/2)) microseconds,
+// except that the first also counts anything faster and the last
+// anything slower (~12 seconds).
+struct TimeSeriesSample
+{
+    static const int LATENCY_BUCKETS = 48;
+
+    int64_t startNanoseconds; // Since the run began
+    int64_t durationNanoseconds;
+
+    int64_t readIOs;
+    int64_t writeIOs;
+    int64_t readBytes;
+    int64_t writeBytes;
+
+    std::array< uint64_t, LATENCY_BUCKETS > latencyCounts;
+
+    TimeSeriesSample()
+        : startNanoseconds( 0 )
+        , durationNanoseconds( 0 )
+        , readIOs( 0 )
+        , writeIOs( 0 )
+        , readBytes( 0 )
+        , writeBytes( 0 )
+    {
+        latencyCounts.fill( 0 );
+    }
+
+    void addLatencies( const LatencyHistogram &histogram )
+    {
+        histogram.forEachBucket( [this]( uint64_t ns, uint64_t count ) {
+            latencyCounts[ getLatencyBucket( ns ) ] += count;
+        } );
+    }
+
+    // Folds in the sample that follows this one
+    void append( const TimeSeriesSample &next )
+    {
+        durationNanoseconds = 
+            next.startNanoseconds + next.durationNanoseconds - 
+            startNanoseconds;
+
+        readIOs += next.readIOs;
+        writeIOs += next.writeIOs;
+        readBytes += next.readBytes;
+        writeBytes += next.writeBytes;
+
+        for( int i = 0; i < LATENCY_BUCKETS; ++i )
+        {
+            latencyCounts[i] += next.latencyCounts[i];
+        }
+    }
+
+    static int getLatencyBucket( uint64_t nanoseconds )
+    {
+        double us = nanoseconds / 1000.0;
+
+        if( us < 1 ) return 0;
+
+        int bucket = static_cast<int>( 2 * std::log2( us ) );
+
+        return std::min( bucket, LATENCY_BUCKETS - 1 );
+    }
+
+    static double getLatencyBucketLowerBound( int bucket )
+    {
+        return ( bucket == 0 ) ? 0 : std::pow( 2.0, bucket / 2.0 );
+    }
+};
+
+// Keeps the time series of a run of any length in bounded memory.
+//
+// Level 0 holds intervals as they were recorded.  Each level above sums
+// pairs from the level below, so it has half the resolution and covers
+// twice the time.  Every level keeps only its newest CAPACITY samples:
+// at most ~7 MB in all, however long we run.  With 100 ms intervals
+// the top level covers over a month, at 55 minute resolution, and a
+// 48 hour run is still described at better than 4 minute resolution.
+//
+// The binary form is the whole pyramid, every field little-endian:
+//
+//   "STSERIES", then uint32 version, levels, and latency buckets
+//   per level: uint32 truncated, uint32 sample count, then the samples
+//   per sample: the six int64 fields above, then the uint64 counts
+class TimeSeriesPyramid
+{
+    private:
+
+    static const int NUM_LEVELS = 16;
+    static const size_t CAPACITY = 1024;
+    static const uint32_t VERSION = 1;
+
+    struct Level
+    {
+        std::deque< TimeSeriesSample > samples;
+
+        // First of a pair, waiting for its partner
+        TimeSeriesSample pending;
+        bool hasPending;
+
+        // Has dropped its oldest samples, so doesn't span the run
+        bool truncated;
+
+        Level()
+            : hasPending( false )
+            , truncated( false )
+        {}
+    };
+
+    std::vector< Level > levels_;
+
+    public:
+
+    TimeSeriesPyramid()
+        : levels_( NUM_LEVELS )
+    {}
+
+    void add( const TimeSeriesSample &sample )
+    {
+        addToLevel( 0, sample );
+    }
+
+    // Pushes any unpaired sample up a level, so every level accounts
+    // for the whole run.  Call once, at the end.
+    void finish()
+    {
+        for( int i = 0; i < NUM_LEVELS - 1; ++i )
+        {
+            if( levels_[i].hasPending )
+            {
+                levels_[i].hasPending = false;
+
+                addToLevel( i + 1, levels_[i].pending );
+            }
+        }
+    }
+
+    // The finest level that still spans the whole run, or failing
+    // that, the coarsest
+    const std::deque< TimeSeriesSample > &getFinestCompleteLevel() const
+    {
+        for( auto &level: levels_ )
+        {
+            if( !level.truncated ) return level.samples;
+        }
+
+        return levels_.back().samples;
+    }
+
+    void writeBinary( std::ostream &out ) const
+    {
+        out.write( "STSERIES", 8 );
+
+        writeField<uint32_t>( out, VERSION );
+        writeField<uint32_t>( out, NUM_LEVELS );
+        writeField<uint32_t>( out, TimeSeriesSample::LATENCY_BUCKETS );
+
+        for( auto &level: levels_ )
+        {
+            writeField<uint32_t>( out, level.truncated ? 1 : 0 );
+            writeField<uint32_t>( 
+                out, static_cast<uint32_t>( level.samples.size() ) );
+
+            for( auto &s: level.samples )
+            {
+                writeField<uint64_t>( out, s.startNanoseconds );
+                writeField<uint64_t>( out, s.durationNanoseconds );
+                writeField<uint64_t>( out, s.readIOs );
+                writeField<uint64_t>( out, s.writeIOs );
+                writeField<uint64_t>( out, s.readBytes );
+                writeField<uint64_t>( out, s.writeBytes );
+
+                for( auto count: s.latencyCounts )
+                {
+                    writeField<uint64_t>( out, count );
+                }
+            }
+        }
+    }
+
+    // One row per interval of the finest complete level.  Latency
+    // columns are named for their lower bound, and count IOs.
+    void writeCsv( std::ostream &out ) const
+    {
+        out.setf( std::ios::fixed );
+        out.precision( 3 );
+
+        out << "Start (s),Duration (s),Read IOPS,Write IOPS,"
+            << "Read MB/s,Write MB/s";
+
+        for( int i = 0; i < TimeSeriesSample::LATENCY_BUCKETS; ++i )
+        {
+            out << ",>= " 
+                << TimeSeriesSample::getLatencyBucketLowerBound( i ) 
+                << " us";
+        }
+
+        out << "\n";
+
+        for( auto &s: getFinestCompleteLevel() )
+        {
+            double seconds = s.durationNanoseconds / 1e9;
+
+            if( seconds <= 0 ) continue;
+
+            out << s.startNanoseconds / 1e9 << ","
+                << seconds << ","
+                << s.readIOs / seconds << ","
+                << s.writeIOs / seconds << ","
+                << s.readBytes / 1024.0 / 1024.0 / seconds << ","
+                << s.writeBytes / 1024.0 / 1024.0 / seconds;
+
+            for( auto count: s.latencyCounts )
+            {
+                out << "," << count;
+            }
+
+            out << "\n";
+        }
+    }
+
+    private:
+
+    void addToLevel( int i, const TimeSeriesSample &sample )
+    {
+        Level &level = levels_[i];
+
+        level.samples.push_back( sample );
+
+        if( level.samples.size() > CAPACITY )
+        {
+            level.samples.pop_front();
+            level.truncated = true;
+        }
+
+        if( i == NUM_LEVELS - 1 ) return;
+
+        if( level.hasPending )
+        {
+            TimeSeriesSample pair = level.pending;
+            pair.append( sample );
+
+            level.hasPending = false;
+
+            addToLevel( i + 1, pair );
+        }
+        else
+        {
+            level.pending = sample;
+            level.hasPending = true;
+        }
+    }
+
+    template<typename T>
+    static void writeField( std::ostream &out, T value )
+    {
+        char bytes[ sizeof( T ) ];
+
+        for( size_t i = 0; i < sizeof( T ); ++i )
+        {
+            bytes[i] = static_cast<char>( value >> ( 8 * i ) );
+        }
+
+        out.write( bytes, sizeof( T ) );
+    }
+};
+
+#endif // __TIME_SERIES_H_
@@ -0,0 +1,106 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __TOKEN_BUCKET_H_
+#define __TOKEN_BUCKET_H_
+
+#include <cstdint>
+#include <algorithm>
+
+// Paces events (IOs, or bytes) to an average rate.
+//
+// Tokens accrue continuously, in QPC ticks rather than on a timer, so
+// the pace holds at any rate.  The bucket only holds a millisecond or so
+// of tokens, which lets a slightly late thread catch up without letting
+// it save up a burst.  Anything is admitted while the balance is
+// positive, and may overdraw it: an IO's size needn't be known before
+// we decide to issue it, and the debt holds off the next one for just
+// as long as the overdraft takes to repay.
+//
+// A default-constructed bucket is unlimited.
+class TokenBucket
+{
+    private:
+
+    static const int64_t BURST_MICROSECONDS = 1000;
+
+    double tokensPerTick_;
+    double capacity_;
+    double tokens_;
+    int64_t lastRefill_;
+
+    public:
+
+    TokenBucket()
+        : tokensPerTick_( 0 )
+        , capacity_( 0 )
+        , tokens_( 0 )
+        , lastRefill_( 0 )
+    {}
+
+    TokenBucket( double tokensPerSecond, int64_t ticksPerSecond, int64_t now )
+        : tokensPerTick_( tokensPerSecond / ticksPerSecond )
+        , capacity_( std::max( 1.0, 
+            tokensPerSecond * BURST_MICROSECONDS / 1e6 ) )
+        , tokens_( capacity_ )
+        , lastRefill_( now )
+    {}
+
+    bool isLimited() const
+    {
+        return tokensPerTick_ > 0;
+    }
+
+    // 0 if we may go now
+    int64_t getTicksUntilReady( int64_t now )
+    {
+        if( !isLimited() ) return 0;
+
+        refill( now );
+
+        if( tokens_ > 0 ) return 0;
+
+        return static_cast<int64_t>( -tokens_ / tokensPerTick_ ) + 1;
+    }
+
+    void spend( double tokens )
+    {
+        if( isLimited() ) tokens_ -= tokens;
+    }
+
+    private:
+
+    void refill( int64_t now )
+    {
+        tokens_ = std::min( capacity_, 
+            tokens_ + ( now - lastRefill_ ) * tokensPerTick_ );
+
+        lastRefill_ = now;
+    }
+};
+
+#endif // __TOKEN_BUCKET_H_
@@ -0,0 +1,296 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __TOPOLOGY_H_
+#define __TOPOLOGY_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "precondition.h"
+
+#ifndef _WIN32
+#include <climits>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/mempolicy.h>
+#endif
+
+// Where the target's device is, and where we can run and allocate near
+// it.  Everything comes from sysfs, and anything sysfs doesn't say is
+// NO_NODE or empty: a missing answer just means we don't place things.
+
+const int NO_NODE = -1;
+
+// For -N, besides a node number
+const int NUMA_AUTO = -2; // The target's node, if there's more than one
+const int NUMA_OFF = -3;
+
+#ifndef _WIN32
+// First line of a sysfs attribute, or empty if there is none
+std::string readSysfsLine( const std::string &path )
+{
+    std::ifstream file( path.c_str() );
+    std::string line;
+
+    std::getline( file, line );
+
+    return line;
+}
+
+// "0-3,8-11" is 0 1 2 3 8 9 10 11, the format of every sysfs CPU and
+// node list
+std::vector<int> parseCpuList( const std::string &list )
+{
+    std::vector<int> cpus;
+    std::istringstream ranges( list );
+    std::string range;
+
+    while( std::getline( ranges, range, ',' ) )
+    {
+        if( range.empty() ) continue;
+
+        size_t dash = range.find( '-' );
+
+        int first = atoi( range.c_str() );
+        int last = ( dash == std::string::npos ) ? 
+            first : atoi( range.c_str() + dash + 1 );
+
+        for( int cpu = first; cpu <= last; ++cpu )
+        {
+            cpus.push_back( cpu );
+        }
+    }
+
+    return cpus;
+}
+
+int getNumNodes()
+{
+    return static_cast<int>( parseCpuList( 
+        readSysfsLine( "/sys/devices/system/node/online" ) ).size() );
+}
+
+// The node of the device behind a block device, or behind the file
+// system a file is on.  Walks up the device's sysfs path to the nearest
+// ancestor (usually the PCI function) that reports one.
+int getTargetNode( const std::string &targetName )
+{
+    struct stat st;
+
+    if( stat( targetName.c_str(), &st ) != 0 ) return NO_NODE;
+
+    dev_t dev = S_ISBLK( st.st_mode ) ? st.st_rdev : st.st_dev;
+
+    std::ostringstream link;
+
+    link << "/sys/dev/block/" << major( dev ) << ":" << minor( dev );
+
+    char resolved[PATH_MAX];
+
+    if( realpath( link.str().c_str(), resolved ) == NULL ) return NO_NODE;
+
+    std::string path( resolved );
+
+    while( path.size() > std::string( "/sys/devices" ).size() )
+    {
+        std::string node = readSysfsLine( path + "/numa_node" );
+
+        if( !node.empty() )
+        {
+            // -1 means the platform doesn't say
+            return std::max( atoi( node.c_str() ), NO_NODE );
+        }
+
+        path.erase( path.rfind( '/' ) );
+    }
+
+    return NO_NODE;
+}
+
+// The node's CPUs that we are allowed to run on
+std::vector<int> getNodeCpus( int node )
+{
+    std::ostringstream path;
+
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+
+    std::vector<int> cpus = parseCpuList( readSysfsLine( path.str() ) );
+
+    cpu_set_t allowed;
+    CPU_ZERO( &allowed );
+
+    if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) != 0 ) 
+    {
+        return cpus;
+    }
+
+    cpus.erase( 
+        std::remove_if( cpus.begin(), cpus.end(), 
+            [&]( int cpu ) { return !CPU_ISSET( cpu, &allowed ); } ),
+        cpus.end() );
+
+    return cpus;
+}
+
+// One CPU per physical core first, then their SMT siblings, so workers
+// only share a core when there are more workers than cores
+std::vector<int> orderByCore( const std::vector<int> &cpus )
+{
+    std::set<int> candidates( cpus.begin(), cpus.end() );
+    std::vector<int> firstThreads;
+    std::vector<int> siblingThreads;
+
+    for( int cpu: cpus )
+    {
+        std::ostringstream path;
+
+        path << "/sys/devices/system/cpu/cpu" << cpu 
+            << "/topology/thread_siblings_list";
+
+        std::vector<int> siblings = parseCpuList( readSysfsLine( path.str() ) );
+
+        bool isFirst = std::none_of( siblings.begin(), siblings.end(),
+            [&]( int s ) { return ( s < cpu ) && candidates.count( s ); } );
+
+        ( isFirst ? firstThreads : siblingThreads ).push_back( cpu );
+    }
+
+    firstThreads.insert( 
+        firstThreads.end(), siblingThreads.begin(), siblingThreads.end() );
+
+    return firstThreads;
+}
+
+// From the node's own meminfo, or 0 if it doesn't say
+int64_t getNodeFreeBytes( int node )
+{
+    std::ostringstream path;
+
+    path << "/sys/devices/system/node/node" << node << "/meminfo";
+
+    std::ifstream meminfo( path.str().c_str() );
+    std::string line;
+
+    // e.g. "Node 0 MemFree:        1234567 kB"
+    while( std::getline( meminfo, line ) )
+    {
+        size_t pos = line.find( "MemFree:" );
+
+        if( pos != std::string::npos )
+        {
+            return atoll( line.c_str() + pos + 8 ) * 1024;
+        }
+    }
+
+    return 0;
+}
+
+bool pinCurrentThread( int cpu )
+{
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+
+    return pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) == 0;
+}
+
+// Threads created afterwards inherit it
+bool setRealTimePriority()
+{
+    sched_param sp;
+    sp.sched_priority = sched_get_priority_min( SCHED_FIFO );
+
+    return pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp ) == 0;
+}
+
+// Moves the pages there now, and keeps new ones there while it can
+bool bindMemoryToNode( void *p, size_t bytes, int node )
+{
+    const int BITS = 8 * sizeof( unsigned long );
+
+    std::vector<unsigned long> mask( node / BITS + 1, 0 );
+
+    mask[node / BITS] = 1UL << ( node % BITS );
+
+    return syscall( SYS_mbind, p, bytes, MPOL_PREFERRED, &mask[0], 
+        mask.size() * BITS + 1, MPOL_MF_MOVE ) == 0;
+}
+#else
+// Windows has no sysfs, so we never find a node to place things on
+int getNumNodes()
+{
+    return 1;
+}
+
+int getTargetNode( const std::string &targetName )
+{
+    return NO_NODE;
+}
+
+std::vector<int> getNodeCpus( int node )
+{
+    return std::vector<int>();
+}
+
+std::vector<int> orderByCore( const std::vector<int> &cpus )
+{
+    return cpus;
+}
+
+int64_t getNodeFreeBytes( int node )
+{
+    return 0;
+}
+
+bool pinCurrentThread( int cpu )
+{
+    return ( cpu < 64 ) && 
+        ( SetThreadAffinityMask( GetCurrentThread(), 1ULL << cpu ) != 0 );
+}
+
+bool setRealTimePriority()
+{
+    return SetThreadPriority( 
+        GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL ) != 0;
+}
+
+bool bindMemoryToNode( void *p, size_t bytes, int node )
+{
+    return false;
+}
+#endif // _WIN32
+
+#endif // __TOPOLOGY_H_
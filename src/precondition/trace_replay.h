@@ -0,0 +1,421 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __TRACE_REPLAY_H_
+#define __TRACE_REPLAY_H_
+
+#include <cstdint>
+#include <cctype>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include <boost/utility.hpp>
+
+#include "precondition.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// One IO from a trace
+struct TraceRecord
+{
+    double seconds; // Since the first record of the trace
+    bool isWrite;
+    bool isDiscard;
+    int64_t offset;
+    int64_t bytes;
+};
+
+// A trace of IOs, one per line:
+//
+//     time,op,offset,bytes
+//
+// time is in seconds, op is R, W, or D (for discard), and offset and
+// bytes are in bytes.  Fields may be separated by commas or blanks,
+// only the first letter of op counts, and anything after bytes is
+// ignored, so lightly post-processed blkparse output will do.  Lines
+// that don't start with a number (headers, comments) are skipped.
+//
+// The file is mapped rather than read, so a trace of any size replays
+// without being loaded.  Workers each parse their own piece of it.
+class TraceFile : boost::noncopyable
+{
+    private:
+
+    std::string name_;
+    const char *data_;
+    int64_t size_;
+    double firstSeconds_;
+    int64_t alignment_;
+
+#ifdef _WIN32
+    HANDLE fileHandle_;
+    HANDLE mappingHandle_;
+#endif
+
+    void failNoIOs() const
+    {
+        std::cerr << "Error: no IOs in trace " << name_ << std::endl;
+        exit( EXIT_FAILURE );
+    }
+
+    public:
+
+    TraceFile()
+        : data_( NULL )
+        , size_( 0 )
+        , firstSeconds_( 0 )
+        , alignment_( SECTOR_SIZE )
+#ifdef _WIN32
+        , fileHandle_( INVALID_HANDLE_VALUE )
+        , mappingHandle_( NULL )
+#endif
+    {}
+
+    ~TraceFile()
+    {
+        if( data_ == NULL ) return;
+
+#ifdef _WIN32
+        UnmapViewOfFile( data_ );
+        CloseHandle( mappingHandle_ );
+        CloseHandle( fileHandle_ );
+#else
+        munmap( const_cast<char *>( data_ ), size_ );
+#endif
+    }
+
+    // Every offset and size in the trace must be a multiple of alignment
+    void open( const std::string &name, int64_t alignment );
+
+    const std::string &getName() const
+    {
+        return name_;
+    }
+
+    int64_t getSize() const
+    {
+        return size_;
+    }
+
+    const char *getData() const
+    {
+        return data_;
+    }
+
+    double getFirstSeconds() const
+    {
+        return firstSeconds_;
+    }
+
+    int64_t getAlignment() const
+    {
+        return alignment_;
+    }
+
+    // Where piece i of n starts: the first line starting at or after
+    // i/n of the way through the file
+    int64_t getPieceStart( int64_t i, int64_t n ) const
+    {
+        if( i == 0 ) return 0;
+        if( i >= n ) return size_;
+
+        int64_t pos = size_ * i / n;
+
+        // Unless we happen to be at the start of a line, skip to the next
+        while( ( pos < size_ ) && ( data_[pos - 1] != '\n' ) ) pos++;
+
+        return pos;
+    }
+};
+
+// Parses one piece of a TraceFile, in order
+class TraceReader : boost::noncopyable
+{
+    private:
+
+    const TraceFile &file_;
+    const char *pos_;
+    const char *const START;
+    const char *const END;
+
+    public:
+
+    TraceReader( const TraceFile &file, int64_t start, int64_t end )
+        : file_( file )
+        , pos_( file.getData() + start )
+        , START( file.getData() + start )
+        , END( file.getData() + end )
+    {}
+
+    // False at the end of our piece.  Exits on a malformed record, or
+    // one we couldn't issue with O_DIRECT.
+    bool next( TraceRecord &record )
+    {
+        while( pos_ < END )
+        {
+            const char *line = pos_;
+
+            skipBlanks();
+
+            bool isRecord = ( pos_ < END ) && 
+                ( isdigit( *pos_ ) || ( *pos_ == '.' ) );
+
+            if( isRecord )
+            {
+                parseRecord( record, line );
+                skipLine();
+
+                return true;
+            }
+
+            skipLine();
+        }
+
+        return false;
+    }
+
+    // How much of our piece we have parsed
+    int64_t getBytesParsed() const
+    {
+        return pos_ - START;
+    }
+
+    private:
+
+    void parseRecord( TraceRecord &record, const char *line )
+    {
+        double seconds;
+        int64_t offset;
+        int64_t bytes;
+
+        bool ok = parseSeconds( seconds );
+
+        skipSeparators();
+
+        char op = static_cast<char>( toupper( ( pos_ < END ) ? *pos_ : 0 ) );
+
+        while( ( pos_ < END ) && isalpha( *pos_ ) ) pos_++;
+
+        skipSeparators();
+        ok = ok && parseInteger( offset );
+
+        skipSeparators();
+        ok = ok && parseInteger( bytes );
+
+        ok = ok && ( ( op == 'R' ) || ( op == 'W' ) || ( op == 'D' ) );
+
+        if( !ok )
+        {
+            fail( line, "expected time,R|W|D,offset,bytes" );
+        }
+
+        const int64_t alignment = file_.getAlignment();
+
+        if( ( offset % alignment != 0 ) || ( bytes % alignment != 0 ) )
+        {
+            fail( line, "offset and bytes must be multiples of " +
+                std::to_string( alignment ) );
+        }
+
+        if( ( bytes <= 0 ) || ( bytes > MAX_IO_SIZE ) )
+        {
+            fail( line, "bytes must be between 1 and " +
+                std::to_string( MAX_IO_SIZE ) );
+        }
+
+        record.seconds = seconds - file_.getFirstSeconds();
+        record.isWrite = ( op == 'W' );
+        record.isDiscard = ( op == 'D' );
+        record.offset = offset;
+        record.bytes = bytes;
+    }
+
+    bool parseSeconds( double &seconds )
+    {
+        int64_t whole = 0;
+        bool sawDigit = parseDigits( whole );
+
+        seconds = static_cast<double>( whole );
+
+        if( ( pos_ < END ) && ( *pos_ == '.' ) )
+        {
+            pos_++;
+
+            double scale = 0.1;
+
+            while( ( pos_ < END ) && isdigit( *pos_ ) )
+            {
+                seconds += ( *pos_++ - '0' ) * scale;
+                scale /= 10;
+                sawDigit = true;
+            }
+        }
+
+        return sawDigit;
+    }
+
+    bool parseInteger( int64_t &value )
+    {
+        value = 0;
+
+        return parseDigits( value );
+    }
+
+    bool parseDigits( int64_t &value )
+    {
+        const char *start = pos_;
+
+        while( ( pos_ < END ) && isdigit( *pos_ ) )
+        {
+            value = value * 10 + ( *pos_++ - '0' );
+        }
+
+        return pos_ > start;
+    }
+
+    void skipBlanks()
+    {
+        while( ( pos_ < END ) && ( ( *pos_ == ' ' ) || ( *pos_ == '\t' ) ) )
+        {
+            pos_++;
+        }
+    }
+
+    void skipSeparators()
+    {
+        while( ( pos_ < END ) && 
+                ( ( *pos_ == ' ' ) || ( *pos_ == '\t' ) || ( *pos_ == ',' ) ) )
+        {
+            pos_++;
+        }
+    }
+
+    void skipLine()
+    {
+        while( ( pos_ < END ) && ( *pos_ != '\n' ) ) pos_++;
+
+        if( pos_ < END ) pos_++;
+    }
+
+    void fail( const char *line, const std::string &why ) const
+    {
+        const char *eol = std::find( line, END, '\n' );
+
+        std::cerr << "Error: bad trace record at byte " 
+            << ( line - file_.getData() ) << " of " << file_.getName() 
+            << ": " << why << std::endl
+            << "  " << std::string( line, eol ) << std::endl;
+
+        exit( EXIT_FAILURE );
+    }
+};
+
+inline void TraceFile::open( const std::string &name, int64_t alignment )
+{
+    name_ = name;
+    alignment_ = alignment;
+
+#ifdef _WIN32
+    fileHandle_ = CreateFileA( 
+        name.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL );
+
+    LARGE_INTEGER fileSize;
+
+    if( ( fileHandle_ == INVALID_HANDLE_VALUE ) || 
+            !GetFileSizeEx( fileHandle_, &fileSize ) )
+    {
+        std::cerr << "Error: couldn't open trace " << name << std::endl;
+        exit( EXIT_FAILURE );
+    }
+
+    size_ = fileSize.QuadPart;
+
+    // Can't map an empty file
+    if( size_ == 0 ) failNoIOs();
+
+    mappingHandle_ = CreateFileMapping( 
+        fileHandle_, NULL, PAGE_READONLY, 0, 0, NULL );
+
+    if( mappingHandle_ != NULL )
+    {
+        data_ = static_cast<const char *>( 
+            MapViewOfFile( mappingHandle_, FILE_MAP_READ, 0, 0, 0 ) );
+    }
+#else
+    int fd = ::open( name.c_str(), O_RDONLY );
+
+    struct stat st;
+
+    if( ( fd < 0 ) || ( fstat( fd, &st ) != 0 ) )
+    {
+        std::cerr << "Error: couldn't open trace " << name << std::endl;
+        exit( EXIT_FAILURE );
+    }
+
+    size_ = st.st_size;
+
+    // Can't map an empty file
+    if( size_ == 0 ) failNoIOs();
+
+    void *p = mmap( NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+    if( p != MAP_FAILED )
+    {
+        // We only ever read forward, so let readahead run
+        madvise( p, size_, MADV_SEQUENTIAL );
+
+        data_ = static_cast<const char *>( p );
+    }
+
+    // The mapping holds its own reference
+    close( fd );
+#endif
+
+    if( data_ == NULL )
+    {
+        std::cerr << "Error: couldn't map trace " << name << std::endl;
+        exit( EXIT_FAILURE );
+    }
+
+    // Times are replayed relative to the first record
+    TraceRecord first;
+
+    if( !TraceReader( *this, 0, size_ ).next( first ) ) failNoIOs();
+
+    firstSeconds_ = first.seconds;
+}
+
+#endif // __TRACE_REPLAY_H_
@@ -0,0 +1,309 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __UNIQUE_PAYLOAD_H_
+#define __UNIQUE_PAYLOAD_H_
+
+#include <cstdint>
+#include <cstring>
+
+#if defined( _M_X64 ) || defined( __x86_64__ )
+#define UNIQUE_PAYLOAD_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined( _MSC_VER ) && defined( UNIQUE_PAYLOAD_X86 )
+#include <intrin.h>
+#endif
+
+// MSVC lets us use any intrinsic anywhere.  GCC and clang need each
+// function told which instruction set it may use.
+#if defined( UNIQUE_PAYLOAD_X86 ) && !defined( _MSC_VER )
+#define TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#define TARGET_AVX512 __attribute__(( target( "avx512f" ) ))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// Write payloads no drive can deduplicate.
+//
+// Every sector starts with a header naming the run, the IO, and the
+// sector's place in the IO, so no two sectors written in a run share a
+// header.  The rest of the sector is hashed rather than copied: word i
+// of an IO is a hash of i and a 64-bit key drawn from the run and IO,
+// and both halves of the key go into every word.  Bodies of different
+// IOs are unrelated streams, not slices of one, so blocks that skip the
+// headers (finer dedupe, delta or similarity matching) match no more
+// than chance would.  Being counter-based, every lane of a SIMD register
+// can work on its own word with no dependency between them.
+struct UniquePayloadHeader
+{
+    uint64_t runNonce;  // Random, per process
+    uint64_t ioId;      // Unique within the run
+    uint64_t sectorIndex;
+};
+
+namespace unique_payload_detail
+{
+    // murmur3's finalizer.  A bijection, so distinct counters give
+    // distinct words.
+    inline uint32_t fmix32( uint32_t x )
+    {
+        x ^= x >> 16;
+        x *= 0x85ebca6b;
+        x ^= x >> 13;
+        x *= 0xc2b2ae35;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Odd multiplier, so a bijection too: distinct IOs, distinct keys
+    inline uint64_t getKey( uint64_t runNonce, uint64_t ioId )
+    {
+        return ( runNonce ^ ioId ) * 0x9E3779B97F4A7C15ULL;
+    }
+
+    // The low half of the key picks where the counter starts, the high
+    // half which stream it runs through.  Two IOs' bodies can only
+    // coincide if the high halves are equal and the low halves closer
+    // than an IO apart.
+    inline uint32_t mixWord( uint64_t key, int64_t i )
+    {
+        uint32_t x = fmix32( 
+            static_cast<uint32_t>( key ) + static_cast<uint32_t>( i ) );
+
+        return fmix32( x ^ static_cast<uint32_t>( key >> 32 ) );
+    }
+
+    // The kernels fill numWords 32-bit words with mixWord( key, i )
+    inline void fillScalar( uint32_t *words, int64_t numWords, uint64_t key )
+    {
+        for( int64_t i = 0; i < numWords; ++i )
+        {
+            words[i] = mixWord( key, i );
+        }
+    }
+
+#ifdef UNIQUE_PAYLOAD_X86
+    TARGET_AVX2
+    inline __m256i fmix256( __m256i x )
+    {
+        const __m256i c1 = _mm256_set1_epi32( 0x85ebca6b );
+        const __m256i c2 = _mm256_set1_epi32( 0xc2b2ae35 );
+
+        x = _mm256_xor_si256( x, _mm256_srli_epi32( x, 16 ) );
+        x = _mm256_mullo_epi32( x, c1 );
+        x = _mm256_xor_si256( x, _mm256_srli_epi32( x, 13 ) );
+        x = _mm256_mullo_epi32( x, c2 );
+        x = _mm256_xor_si256( x, _mm256_srli_epi32( x, 16 ) );
+
+        return x;
+    }
+
+    TARGET_AVX2
+    void fillAvx2( uint32_t *words, int64_t numWords, uint64_t key )
+    {
+        const __m256i high = _mm256_set1_epi32( 
+            static_cast<uint32_t>( key >> 32 ) );
+        const __m256i step = _mm256_set1_epi32( 8 );
+
+        __m256i counter = _mm256_add_epi32(
+            _mm256_set1_epi32( static_cast<uint32_t>( key ) ),
+            _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+
+        int64_t i = 0;
+
+        for( ; i + 8 <= numWords; i += 8 )
+        {
+            __m256i x = fmix256( _mm256_xor_si256( fmix256( counter ), high ) );
+
+            _mm256_storeu_si256( reinterpret_cast<__m256i *>( words + i ), x );
+
+            counter = _mm256_add_epi32( counter, step );
+        }
+
+        for( ; i < numWords; ++i )
+        {
+            words[i] = mixWord( key, i );
+        }
+    }
+
+    // The zero-masking form computes the same thing as _mm512_srli_epi32,
+    // without tripping GCC 12's -Wmaybe-uninitialized inside its header
+    TARGET_AVX512
+    inline __m512i srli512( __m512i x, unsigned int n )
+    {
+        return _mm512_maskz_srli_epi32( 0xFFFF, x, n );
+    }
+
+    TARGET_AVX512
+    inline __m512i fmix512( __m512i x )
+    {
+        const __m512i c1 = _mm512_set1_epi32( 0x85ebca6b );
+        const __m512i c2 = _mm512_set1_epi32( 0xc2b2ae35 );
+
+        x = _mm512_xor_si512( x, srli512( x, 16 ) );
+        x = _mm512_mullo_epi32( x, c1 );
+        x = _mm512_xor_si512( x, srli512( x, 13 ) );
+        x = _mm512_mullo_epi32( x, c2 );
+        x = _mm512_xor_si512( x, srli512( x, 16 ) );
+
+        return x;
+    }
+
+    TARGET_AVX512
+    void fillAvx512( uint32_t *words, int64_t numWords, uint64_t key )
+    {
+        const __m512i high = _mm512_set1_epi32( 
+            static_cast<uint32_t>( key >> 32 ) );
+        const __m512i step = _mm512_set1_epi32( 16 );
+
+        __m512i counter = _mm512_add_epi32(
+            _mm512_set1_epi32( static_cast<uint32_t>( key ) ),
+            _mm512_setr_epi32( 
+                0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ) );
+
+        int64_t i = 0;
+
+        for( ; i + 16 <= numWords; i += 16 )
+        {
+            __m512i x = fmix512( _mm512_xor_si512( fmix512( counter ), high ) );
+
+            _mm512_storeu_si512( words + i, x );
+
+            counter = _mm512_add_epi32( counter, step );
+        }
+
+        for( ; i < numWords; ++i )
+        {
+            words[i] = mixWord( key, i );
+        }
+    }
+
+    inline bool cpuHasAvx2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+
+        __cpuid( info, 0 );
+        if( info[0] < 7 ) return false;
+
+        // The OS must save the upper halves of the registers too
+        __cpuid( info, 1 );
+        bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+        if( !osxsave || ( ( _xgetbv( 0 ) & 0x6 ) != 0x6 ) ) return false;
+
+        __cpuidex( info, 7, 0 );
+        return ( info[1] & ( 1 << 5 ) ) != 0;
+#else
+        return __builtin_cpu_supports( "avx2" );
+#endif
+    }
+
+    inline bool cpuHasAvx512()
+    {
+#ifdef _MSC_VER
+        if( !cpuHasAvx2() ) return false;
+
+        // opmask and ZMM state too
+        if( ( _xgetbv( 0 ) & 0xE6 ) != 0xE6 ) return false;
+
+        int info[4];
+        __cpuidex( info, 7, 0 );
+        return ( info[1] & ( 1 << 16 ) ) != 0;
+#else
+        return __builtin_cpu_supports( "avx512f" );
+#endif
+    }
+#endif // UNIQUE_PAYLOAD_X86
+
+    typedef void (*FillKernel)( uint32_t *, int64_t, uint64_t );
+
+    struct Kernel
+    {
+        FillKernel fill;
+        const char *name;
+    };
+
+    // Picked once, on first use
+    inline const Kernel &getKernel()
+    {
+        static const Kernel kernel = []()
+        {
+#ifdef UNIQUE_PAYLOAD_X86
+            if( cpuHasAvx512() ) return Kernel{ fillAvx512, "avx512" };
+            if( cpuHasAvx2() ) return Kernel{ fillAvx2, "avx2" };
+#endif
+            return Kernel{ fillScalar, "scalar" };
+        }();
+
+        return kernel;
+    }
+}
+
+// Which SIMD flavor this CPU gets, for the report
+const char *getUniquePayloadKernelName()
+{
+    return unique_payload_detail::getKernel().name;
+}
+
+// Incompressible, and unrelated to any other IO's body
+void fillPayloadBody(
+        uint8_t *buffer,
+        int64_t bytes,
+        uint64_t runNonce,
+        uint64_t ioId )
+{
+    using namespace unique_payload_detail;
+
+    getKernel().fill( 
+        reinterpret_cast<uint32_t *>( buffer ),
+        bytes / sizeof( uint32_t ),
+        getKey( runNonce, ioId ) );
+}
+
+// bytes must be a multiple of SECTOR_SIZE
+void fillUniquePayload(
+        uint8_t *buffer,
+        int64_t bytes,
+        uint64_t runNonce,
+        uint64_t ioId )
+{
+    fillPayloadBody( buffer, bytes, runNonce, ioId );
+
+    UniquePayloadHeader header = { runNonce, ioId, 0 };
+
+    for( int64_t offset = 0; offset < bytes; offset += SECTOR_SIZE )
+    {
+        memcpy( buffer + offset, &header, sizeof( header ) );
+
+        header.sectorIndex++;
+    }
+}
+
+#endif // __UNIQUE_PAYLOAD_H_
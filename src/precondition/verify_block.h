@@ -0,0 +1,222 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __VERIFY_BLOCK_H_
+#define __VERIFY_BLOCK_H_
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#include "crc32c.h"
+#include "unique_payload.h"
+
+// In verify mode every sector written starts with one of these.  The
+// CRC covers everything after it, header and payload both, so a read
+// can tell a sector that was corrupted, or landed in the wrong place,
+// without knowing what was written.
+struct VerifyHeader
+{
+    uint32_t magic;
+    uint32_t crc;
+    uint64_t lba;       // In SECTOR_SIZE units
+    uint64_t pass;
+    uint64_t seed;      // Random, per run
+    uint64_t timestamp; // qpc() when stamped
+};
+
+const uint32_t VERIFY_MAGIC = 0x56435353; // "SSCV"
+
+// Everything past the crc field
+const size_t VERIFY_CRC_START = 
+    offsetof( VerifyHeader, crc ) + sizeof( uint32_t );
+
+enum VerifyProblem
+{
+    VERIFY_NO_HEADER,   // We wrote it, but there's no header
+    VERIFY_BAD_CRC,     // Contents changed after we wrote them
+    VERIFY_WRONG_LBA,   // Misdirected write, or misdirected read
+    VERIFY_STALE        // We wrote it, but read back an older version
+};
+
+struct VerifyMismatch
+{
+    int64_t offset;
+    VerifyProblem problem;
+    VerifyHeader header; // As read
+};
+
+std::string describeVerifyMismatch( const VerifyMismatch &m )
+{
+    static const char *PROBLEMS[] = 
+        { "no header", "bad CRC", "wrong LBA", "stale data" };
+
+    std::ostringstream msg;
+
+    msg << "verify mismatch at offset " << m.offset 
+        << ": " << PROBLEMS[m.problem]
+        << " (lba " << m.header.lba
+        << ", pass " << m.header.pass
+        << ", seed " << std::hex << m.header.seed << std::dec
+        << ", timestamp " << m.header.timestamp << ")";
+
+    return msg.str();
+}
+
+// Sectors checked per CRC batch
+const int64_t VERIFY_BATCH_SECTORS = 64;
+
+// bytes and offset must be multiples of SECTOR_SIZE
+void stampVerifyBlocks( 
+        uint8_t *buffer, 
+        int64_t bytes, 
+        int64_t offset, 
+        uint64_t pass, 
+        uint64_t seed,
+        uint64_t ioId )
+{
+    fillPayloadBody( buffer, bytes, seed, ioId );
+
+    const int64_t numSectors = bytes / SECTOR_SIZE;
+
+    VerifyHeader header = 
+        { VERIFY_MAGIC, 0, static_cast<uint64_t>( offset / SECTOR_SIZE ), 
+            pass, seed, static_cast<uint64_t>( qpc() ) };
+
+    for( int64_t i = 0; i < numSectors; ++i )
+    {
+        memcpy( buffer + i * SECTOR_SIZE, &header, sizeof( header ) );
+
+        header.lba++;
+    }
+
+    uint32_t crcs[VERIFY_BATCH_SECTORS];
+
+    for( int64_t i = 0; i < numSectors; i += VERIFY_BATCH_SECTORS )
+    {
+        int64_t n = std::min( VERIFY_BATCH_SECTORS, numSectors - i );
+
+        crc32cBlocks( 
+            buffer + i * SECTOR_SIZE + VERIFY_CRC_START,
+            SECTOR_SIZE,
+            SECTOR_SIZE - VERIFY_CRC_START,
+            n,
+            crcs );
+
+        for( int64_t j = 0; j < n; ++j )
+        {
+            memcpy( buffer + ( i + j ) * SECTOR_SIZE + 
+                offsetof( VerifyHeader, crc ), &crcs[j], sizeof( uint32_t ) );
+        }
+    }
+}
+
+// Checks sectors read from offset.  If mustBeCurrent, we wrote them
+// earlier in this run, so they must carry our seed.  Otherwise a sector
+// without a header was simply never written in verify mode, and one
+// from an earlier run is fine as long as it is intact.
+//
+// Returns the number of bad sectors.  Up to maxReports are appended
+// to mismatches.
+int64_t checkVerifyBlocks( 
+        const uint8_t *buffer, 
+        int64_t bytes, 
+        int64_t offset, 
+        uint64_t seed,
+        bool mustBeCurrent,
+        std::vector<VerifyMismatch> &mismatches,
+        size_t maxReports )
+{
+    const int64_t numSectors = bytes / SECTOR_SIZE;
+
+    int64_t badSectors = 0;
+
+    uint32_t crcs[VERIFY_BATCH_SECTORS];
+
+    for( int64_t i = 0; i < numSectors; i += VERIFY_BATCH_SECTORS )
+    {
+        int64_t n = std::min( VERIFY_BATCH_SECTORS, numSectors - i );
+
+        crc32cBlocks( 
+            buffer + i * SECTOR_SIZE + VERIFY_CRC_START,
+            SECTOR_SIZE,
+            SECTOR_SIZE - VERIFY_CRC_START,
+            n,
+            crcs );
+
+        for( int64_t j = 0; j < n; ++j )
+        {
+            int64_t sector = i + j;
+
+            VerifyMismatch m;
+
+            m.offset = offset + sector * SECTOR_SIZE;
+
+            memcpy( &m.header, buffer + sector * SECTOR_SIZE, 
+                sizeof( m.header ) );
+
+            if( m.header.magic != VERIFY_MAGIC )
+            {
+                if( !mustBeCurrent ) continue;
+
+                m.problem = VERIFY_NO_HEADER;
+            }
+            else if( m.header.crc != crcs[j] )
+            {
+                m.problem = VERIFY_BAD_CRC;
+            }
+            else if( m.header.lba != 
+                static_cast<uint64_t>( m.offset / SECTOR_SIZE ) )
+            {
+                m.problem = VERIFY_WRONG_LBA;
+            }
+            else if( mustBeCurrent && ( m.header.seed != seed ) )
+            {
+                m.problem = VERIFY_STALE;
+            }
+            else
+            {
+                continue;
+            }
+
+            badSectors++;
+
+            if( mismatches.size() < maxReports )
+            {
+                mismatches.push_back( m );
+            }
+        }
+    }
+
+    return badSectors;
+}
+
+#endif // __VERIFY_BLOCK_H_
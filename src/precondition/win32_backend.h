@@ -0,0 +1,236 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#pragma once
+#ifndef __WIN32_BACKEND_H_
+#define __WIN32_BACKEND_H_
+
+#ifdef _WIN32
+
+#include "precondition.h"
+#include "io_backend.h"
+
+// Overlapped IO with completion routines.  The routines are delivered as
+// APCs, so they only run while reap() sits in an alertable SleepEx.
+//
+// Trims have no ...Ex form with a completion routine, so discards are
+// done synchronously in submit(), and the IOs already in flight on this
+// thread wait that long to be reaped.
+class Win32Backend : public IOBackend
+{
+    private:
+
+    HANDLE targetHandle_;
+    bool rawDisk_;
+
+    std::vector< OVERLAPPED > overlapped_;
+    std::vector< IOCompletion > completed_;
+
+    int64_t inFlight_;
+
+    public:
+
+    Win32Backend( int64_t queueDepth )
+        : targetHandle_( INVALID_HANDLE_VALUE )
+        , rawDisk_( false )
+        , overlapped_( queueDepth )
+        , inFlight_( 0 )
+    {
+        completed_.reserve( queueDepth );
+
+        for( auto &i: overlapped_ )
+        {
+            // Completion routines allow us to abuse the hEvent field
+            // See ioCompletionRoutine for the matching cast back.
+            i.hEvent = reinterpret_cast<HANDLE>( this );
+        }
+    }
+
+    std::string getName() const
+    {
+        return "win32";
+    }
+
+    void openTarget( const std::string& targetName, bool rawDisk )
+    {
+        targetHandle_ = checkedOpenTarget( targetName );
+        rawDisk_ = rawDisk;
+    }
+
+    void closeTarget()
+    {
+        CloseHandle( targetHandle_ );
+        targetHandle_ = INVALID_HANDLE_VALUE;
+    }
+
+    int64_t getTargetSize()
+    {
+        return rawDisk_ ?
+            checkedGetDiskLength( targetHandle_ ) :
+            checkedGetFileSizeEx( targetHandle_ );
+    }
+
+    TargetGeometry getTargetGeometry()
+    {
+        return queryTargetGeometry( targetHandle_, rawDisk_ );
+    }
+
+    void submit( const IORequest& request )
+    {
+        if( request.isDiscard )
+        {
+            IOCompletion completion;
+
+            completion.slot = request.slot;
+            completion.error = discardRange( 
+                targetHandle_, rawDisk_, request.offset, request.bytes );
+            completion.bytes = ( completion.error == 0 ) ? request.bytes : 0;
+
+            completed_.push_back( completion );
+
+            return;
+        }
+
+        LARGE_INTEGER fileOffset;
+        fileOffset.QuadPart = request.offset;
+
+        OVERLAPPED *op = &overlapped_[request.slot];
+
+        op->Offset = fileOffset.LowPart;
+        op->OffsetHigh = fileOffset.HighPart;
+
+        if( request.isWrite )
+        {
+            checkedWriteFileEx(
+                    targetHandle_,
+                    request.buffer,
+                    static_cast<DWORD>( request.bytes ),
+                    op,
+                    &ioCompletionRoutine );
+        }
+        else
+        {
+            checkedReadFileEx(
+                    targetHandle_,
+                    request.buffer,
+                    static_cast<DWORD>( request.bytes ),
+                    op,
+                    &ioCompletionRoutine );
+        }
+
+        inFlight_++;
+    }
+
+    size_t reap(
+        std::vector<IOCompletion>& completions,
+        int64_t timeoutNanoseconds,
+        size_t minCompletions )
+    {
+        assert( ( inFlight_ > 0 ) || !completed_.empty() );
+
+        // Completion routines move IOs from inFlight_ to completed_, so
+        // this can't change while we wait
+        size_t wanted = std::min<size_t>( 
+            minCompletions, completed_.size() + inFlight_ );
+
+        int64_t deadline = qpc() +
+            timeoutNanoseconds * QPC_TICKS_PER_SEC / 1000000000LL;
+
+        while( completed_.size() < wanted )
+        {
+            DWORD waitMs = INFINITE;
+
+            if( timeoutNanoseconds != WAIT_FOREVER )
+            {
+                int64_t remaining = deadline - qpc();
+
+                // SleepEx is millisecond granular, so round up.  Out of
+                // time, we still take one look for queued completions.
+                waitMs = ( remaining <= 0 ) ? 0 : static_cast<DWORD>(
+                    divRoundUp( remaining * 1000, QPC_TICKS_PER_SEC ) );
+            }
+
+            // Alertable wait allows async IOs to complete
+            SleepEx( waitMs, true );
+
+            if( waitMs == 0 ) break;
+        }
+
+        size_t numReaped = completed_.size();
+
+        completions.insert(
+            completions.end(), completed_.begin(), completed_.end() );
+
+        completed_.clear();
+
+        return numReaped;
+    }
+
+    void cancel()
+    {
+        CancelIoEx( targetHandle_, NULL );
+
+        while( inFlight_ > 0 )
+        {
+            SleepEx( INFINITE, true );
+        }
+
+        completed_.clear();
+    }
+
+    void flush()
+    {
+        checkedFlushFileBuffers( targetHandle_ );
+    }
+
+    private:
+
+    static void CALLBACK ioCompletionRoutine(
+            DWORD error,
+            DWORD bytes,
+            LPOVERLAPPED overlapped )
+    {
+        assert( overlapped != NULL );
+
+        // Coerce our secret pointer back to its proper type.
+        Win32Backend *backend = 
+            reinterpret_cast<Win32Backend*>( overlapped->hEvent );
+
+        assert( backend != NULL );
+
+        IOCompletion completion;
+
+        completion.slot = overlapped - &backend->overlapped_[0];
+        completion.bytes = bytes;
+        completion.error = error;
+
+        backend->completed_.push_back( completion );
+        backend->inFlight_--;
+    }
+};
+
+#endif // _WIN32
+#endif // __WIN32_BACKEND_H_
@@ -0,0 +1,391 @@
+// StorScore
+//
+// Copyright (c) Microsoft Corporation
+//
+// All rights reserved. 
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+// Checks precondition's arithmetic against slow, obviously correct
+// versions of the same thing, and the CRC32C kernels against known
+// values and each other.  Unlike regr.cmd this runs real code, but needs
+// no target and finishes in a second or so.  Build and run from this
+// directory:
+//
+//   cl /EHsc /O2 /I..\src\precondition precondition_selftest.cpp
+//   c++ -std=c++11 -O2 -I../src/precondition -o precondition_selftest
+//       precondition_selftest.cpp
+//
+// Prints each failure and exits non-zero if there were any.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+#include "sliding_linear_fit.h"
+#include "steady_state_policy.h"
+#include "crc32c.h"
+
+using namespace std;
+
+int numChecks = 0;
+int numFailures = 0;
+
+void check( bool ok, const string &what )
+{
+    numChecks++;
+
+    if( !ok )
+    {
+        numFailures++;
+        cerr << "FAILED: " << what << "\n";
+    }
+}
+
+bool isClose( double a, double b, double tolerance )
+{
+    return abs( a - b ) <= tolerance;
+}
+
+// Least-squares fit of y against x = 1, 2, ... y.size(), from scratch
+void naiveFit( const deque<double> &y, double &slope, double &rSquared )
+{
+    double n = static_cast<double>( y.size() );
+    double meanX = ( n + 1 ) / 2;
+    double meanY = 0;
+
+    for( auto v: y ) meanY += v;
+
+    meanY /= n;
+
+    double covXY = 0;
+    double varX = 0;
+    double varY = 0;
+
+    for( size_t i = 0; i < y.size(); ++i )
+    {
+        double dx = ( i + 1 ) - meanX;
+        double dy = y[i] - meanY;
+
+        covXY += dx * dy;
+        varX += dx * dx;
+        varY += dy * dy;
+    }
+
+    slope = covXY / varX;
+    rSquared = ( varY > 0 ) ? ( covXY * covXY ) / ( varX * varY ) : 0;
+}
+
+// Throughput-like bins: a noisy ramp that levels off, then a step, so
+// windows are both steady and not
+vector<double> makeBins( size_t count, uint32_t seed )
+{
+    mt19937 rng( seed );
+    normal_distribution<double> noise( 0, 0.02 );
+
+    vector<double> bins;
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        double level = 4e9 * min( 1.0, 0.3 + i / ( count / 3.0 ) );
+
+        if( i > count * 2 / 3 ) level *= 0.5;
+
+        bins.push_back( level * ( 1 + noise( rng ) ) );
+    }
+
+    return bins;
+}
+
+// Slides across far more points than any run would, so drift in the
+// running sums would show
+void checkSlidingLinearFit()
+{
+    for( int64_t window: { 2, 5, 37, 600 } )
+    {
+        vector<double> bins = makeBins( 200000, 
+            static_cast<uint32_t>( window ) );
+
+        SlidingLinearFit fit( window );
+        deque<double> y( window, 0 );
+
+        int mismatches = 0;
+
+        for( size_t i = 0; i < bins.size(); ++i )
+        {
+            fit.slide( y.front(), bins[i] );
+
+            y.pop_front();
+            y.push_back( bins[i] );
+
+            // The naive fit is O(window), so sample the later slides
+            if( ( i > 1000 ) && ( i % 97 != 0 ) ) continue;
+
+            double slope, rSquared;
+            double expectedSlope, expectedRSquared;
+
+            tie( slope, rSquared ) = fit.get();
+            naiveFit( y, expectedSlope, expectedRSquared );
+
+            // R^2 of a nearly flat window is mostly rounding in var(y),
+            // in the full refit as much as in the running sums
+            double sumSqY = 0;
+            double varY = 0;
+            double meanY = accumulate( y.begin(), y.end(), 0.0 ) / window;
+
+            for( auto v: y ) 
+            {
+                sumSqY += v * v;
+                varY += ( v - meanY ) * ( v - meanY );
+            }
+
+            bool rSquaredMeaningful = ( varY > 1e-6 * sumSqY );
+
+            // Relative to the size of the values, as the sums are
+            if( !isClose( slope, expectedSlope, 1e-9 * 4e9 ) ||
+                    ( rSquaredMeaningful && 
+                        !isClose( rSquared, expectedRSquared, 1e-6 ) ) )
+            {
+                mismatches++;
+            }
+        }
+
+        ostringstream what;
+        what << "SlidingLinearFit matches a full refit, window " << window
+            << " (" << mismatches << " mismatches)";
+
+        check( mismatches == 0, what.str() );
+    }
+}
+
+void checkSlopePolicy()
+{
+    const size_t WINDOW = 30;
+    const double TOLERANCE = 0.5;
+    const double BIN_SCALE = 4096 * 1000;
+
+    vector<double> bins = makeBins( 3000, 7 );
+
+    SlopePolicy policy( WINDOW, TOLERANCE, BIN_SCALE );
+    deque<double> y( WINDOW, 0 );
+
+    int mismatches = 0;
+    int steady = 0;
+
+    for( auto b: bins )
+    {
+        policy.trackBin( y.front(), b );
+
+        y.pop_front();
+        y.push_back( b );
+
+        double slope, rSquared;
+        naiveFit( y, slope, rSquared );
+
+        bool expected = abs( slope / BIN_SCALE ) <= TOLERANCE;
+
+        // Too close to call either way after rounding
+        if( isClose( abs( slope / BIN_SCALE ), TOLERANCE, 1e-6 ) ) continue;
+
+        if( policy.withinTolerance() != expected ) mismatches++;
+        if( expected ) steady++;
+    }
+
+    check( mismatches == 0, "SlopePolicy agrees with a full refit" );
+    check( ( steady > 0 ) && ( steady < static_cast<int>( bins.size() ) ),
+        "SlopePolicy test data is both steady and not" );
+}
+
+// The PTS rule from the spec's own definitions: rounds of consecutive
+// bins, the last five of them, max minus min and the fitted line's
+// rise across them, each as a fraction of their average
+void checkPtsPolicy()
+{
+    for( size_t window: { 5, 12, 50 } )
+    {
+        const size_t BINS_PER_ROUND = max<size_t>( 1, window / 5 );
+        const int NUM_ROUNDS = 5;
+
+        vector<double> bins = makeBins( 4000, 
+            static_cast<uint32_t>( window ) );
+
+        PtsPolicy policy( window );
+
+        deque<double> rounds;
+        double roundTotal = 0;
+        size_t binsInRound = 0;
+
+        int mismatches = 0;
+        int steady = 0;
+        int judged = 0;
+
+        for( auto b: bins )
+        {
+            policy.trackBin( 0, b );
+
+            roundTotal += b;
+
+            if( ++binsInRound == BINS_PER_ROUND )
+            {
+                rounds.push_back( roundTotal );
+                if( rounds.size() > NUM_ROUNDS ) rounds.pop_front();
+
+                roundTotal = 0;
+                binsInRound = 0;
+            }
+
+            bool full = ( rounds.size() == NUM_ROUNDS );
+
+            if( policy.full() != full ) mismatches++;
+
+            if( !full ) continue;
+
+            double average = 0;
+            for( auto r: rounds ) average += r;
+            average /= NUM_ROUNDS;
+
+            double excursion = ( *max_element( rounds.begin(), rounds.end() ) -
+                *min_element( rounds.begin(), rounds.end() ) ) / average;
+
+            double slope, rSquared;
+            naiveFit( rounds, slope, rSquared );
+
+            double slopeExcursion = abs( slope ) * ( NUM_ROUNDS - 1 ) / average;
+
+            bool expected = ( excursion <= 0.20 ) && ( slopeExcursion <= 0.10 );
+
+            // Reported to a tenth of a percent
+            double reportedExcursion, reportedSlopeExcursion;
+
+            if( sscanf( policy.getProgressMessage().c_str(), 
+                    "excursion %lf%%, slope excursion %lf%%",
+                    &reportedExcursion, &reportedSlopeExcursion ) != 2 ||
+                    !isClose( reportedExcursion, excursion * 100, 0.051 ) ||
+                    !isClose( reportedSlopeExcursion, 
+                        slopeExcursion * 100, 0.051 ) )
+            {
+                mismatches++;
+            }
+
+            if( !isClose( excursion, 0.20, 1e-9 ) && 
+                    !isClose( slopeExcursion, 0.10, 1e-9 ) )
+            {
+                if( policy.withinTolerance() != expected ) mismatches++;
+            }
+
+            judged++;
+            if( expected ) steady++;
+        }
+
+        ostringstream what;
+        what << "PtsPolicy matches the spec's rule, window " << window 
+            << " (" << mismatches << " mismatches)";
+
+        check( mismatches == 0, what.str() );
+        check( ( steady > 0 ) && ( steady < judged ),
+            "PtsPolicy test data is both steady and not" );
+    }
+}
+
+void checkCrc32c()
+{
+    // The check value from the CRC catalogue, and RFC 3720's all-zeros
+    const char *digits = "123456789";
+    const uint8_t zeros[32] = { 0 };
+
+    check( crc32c( digits, 9 ) == 0xE3069283, 
+        string( "CRC32C of \"123456789\", " ) + getCrc32cKernelName() );
+
+    check( crc32c( zeros, sizeof( zeros ) ) == 0x8A9136AA,
+        string( "CRC32C of 32 zero bytes, " ) + getCrc32cKernelName() );
+
+    check( ~crc32c_detail::updateSoftware( 
+        ~0U, reinterpret_cast<const uint8_t *>( digits ), 9 ) == 0xE3069283,
+        "CRC32C of \"123456789\", software" );
+
+#if defined( CRC32C_X86 ) || defined( CRC32C_ARM )
+    if( !crc32c_detail::cpuHasCrc32c() )
+    {
+        cout << "No CRC32C instructions; only the software kernel checked\n";
+        return;
+    }
+
+    // Lengths either side of the 8-byte step, strides that do and don't
+    // leave the blocks 8-byte aligned, and counts either side of the
+    // three blocks done side by side
+    mt19937 rng( 1 );
+    vector<uint8_t> buffer( 64 * 1024 );
+
+    for( auto &b: buffer ) b = static_cast<uint8_t>( rng() );
+
+    int mismatches = 0;
+
+    for( size_t offset: { 0, 1, 3, 8 } )
+    for( size_t bytes: { 0, 1, 7, 8, 9, 63, 64, 65, 512, 4096 } )
+    for( size_t extra: { 0, 1, 8, 13 } )
+    for( int64_t count = 1; count <= 7; ++count )
+    {
+        size_t stride = bytes + extra;
+
+        uint32_t software[7];
+        uint32_t hardware[7];
+
+        crc32c_detail::blocksSoftware( 
+            &buffer[offset], stride, bytes, count, software );
+
+        crc32c_detail::blocksHardware( 
+            &buffer[offset], stride, bytes, count, hardware );
+
+        for( int64_t i = 0; i < count; ++i )
+        {
+            if( software[i] != hardware[i] ) mismatches++;
+        }
+    }
+
+    ostringstream what;
+    what << "CRC32C software and " << getCrc32cKernelName() 
+        << " kernels agree (" << mismatches << " mismatches)";
+
+    check( mismatches == 0, what.str() );
+#endif
+}
+
+int main()
+{
+    checkSlidingLinearFit();
+    checkSlopePolicy();
+    checkPtsPolicy();
+    checkCrc32c();
+
+    cout << numChecks - numFailures << " of " << numChecks 
+        << " checks passed\n";
+
+    return ( numFailures == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
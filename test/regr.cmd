@@ -190,6 +190,8 @@ run_one( "--partition_bytes=1000000000 --raw_disk" );
 run_one( "--compressibility=110" );
 run_one( "--raw_disk --target=P:" );
 run_one( "--raw_disk --target=P:\\fake" );
+run_one( "--steady_state_rule=bogus" );
+run_one( "--verify --compressibility=50" );
 
 # These are the defaults anyway, so just run them once
 run_one( "--active_range=100" );
@@ -221,6 +223,9 @@ run_matrix( "--warmup_time_override=42" );
 run_matrix( "--compressibility=0" );
 run_matrix( "--compressibility=1" );
 run_matrix( "--compressibility=20" );
+run_matrix( "--compressibility=50" );
+run_matrix( "--steady_state_rule=pts" );
+run_matrix( "--verify" );
 run_matrix( "--results_share=\\\\share\\dir" );
 run_matrix( "--io_generator=sqlio" );
 run_matrix( "--nopurge --target=1234" );